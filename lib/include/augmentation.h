@@ -0,0 +1,31 @@
+#pragma once
+#include "policy.h"
+#include <cstddef>
+
+namespace BST {
+    struct AugmentationPolicyTag {};
+
+    struct NoAugmentation {
+        using policy_category = AugmentationPolicyTag;
+        using node_data = void;
+    };
+
+    struct SubtreeSizeNodeData {
+        static constexpr bool kAggregatesSubtree = true;
+
+        std::size_t subtree_size = 1;
+
+        template<typename NodeType>
+        void Refresh(const NodeType& node) {
+            std::size_t left_size = (node.left == nullptr) ? 0 : node.left->subtree_size;
+            std::size_t right_size = (node.right == nullptr) ? 0 : node.right->subtree_size;
+            subtree_size = left_size + right_size + 1;
+        }
+    };
+
+    // Keeps subtree sizes in every node for rank/select, count_range and O(log n) distance/advance
+    struct OrderStatistics {
+        using policy_category = AugmentationPolicyTag;
+        using node_data = SubtreeSizeNodeData;
+    };
+}
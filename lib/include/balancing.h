@@ -0,0 +1,497 @@
+#pragma once
+#include "policy.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace BST {
+    struct BalancingPolicyTag {};
+
+    namespace detail {
+        // All helpers below work on a plain tree: root->parent == nullptr and leaves end with nullptr,
+        // the end_ptr_ sentinel is detached by the container beforehand
+
+        template<typename NodePointer>
+        void RotateLeft(NodePointer& root, NodePointer node) {
+            NodePointer pivot = node->right;
+            node->right = pivot->left;
+            if (pivot->left != nullptr) {
+                pivot->left->parent = node;
+            }
+
+            pivot->parent = node->parent;
+            if (node->parent == nullptr) {
+                root = pivot;
+            } else if (node->parent->left == node) {
+                node->parent->left = pivot;
+            } else {
+                node->parent->right = pivot;
+            }
+
+            pivot->left = node;
+            node->parent = pivot;
+
+            node->RefreshData();
+            pivot->RefreshData();
+        }
+
+        template<typename NodePointer>
+        void RotateRight(NodePointer& root, NodePointer node) {
+            NodePointer pivot = node->left;
+            node->left = pivot->right;
+            if (pivot->right != nullptr) {
+                pivot->right->parent = node;
+            }
+
+            pivot->parent = node->parent;
+            if (node->parent == nullptr) {
+                root = pivot;
+            } else if (node->parent->right == node) {
+                node->parent->right = pivot;
+            } else {
+                node->parent->left = pivot;
+            }
+
+            pivot->right = node;
+            node->parent = pivot;
+
+            node->RefreshData();
+            pivot->RefreshData();
+        }
+
+        // Recomputes node data from node up to the root. Aggregates over whole subtrees (see
+        // SubtreeAggregateData) change on every ancestor of a linked or unlinked node, so the container
+        // runs this before any rotation, which then recomputes from up to date children
+        template<typename NodePointer>
+        void RefreshPath(NodePointer node) {
+            while (node != nullptr) {
+                node->RefreshData();
+                node = node->parent;
+            }
+        }
+
+        template<typename NodePointer>
+        void Transplant(NodePointer& root, NodePointer old_node, NodePointer new_node) {
+            if (old_node->parent == nullptr) {
+                root = new_node;
+            } else if (old_node->parent->left == old_node) {
+                old_node->parent->left = new_node;
+            } else {
+                old_node->parent->right = new_node;
+            }
+
+            if (new_node != nullptr) {
+                new_node->parent = old_node->parent;
+            }
+        }
+
+        // Makes pivot the root of left and right (roots of plain trees, every key of left < pivot < every
+        // key of right) and returns it without a parent
+        template<typename NodePointer>
+        NodePointer LinkPivot(NodePointer left, NodePointer pivot, NodePointer right) {
+            pivot->left = left;
+            pivot->right = right;
+            pivot->parent = nullptr;
+            if (left != nullptr) {
+                left->parent = pivot;
+            }
+            if (right != nullptr) {
+                right->parent = pivot;
+            }
+            pivot->RefreshData();
+
+            return pivot;
+        }
+
+        // Relinks node out of the tree without touching any value. Returns the child that took the removed
+        // position and its parent. When node had two children its successor takes its place and the two swap
+        // node data, so node's data describes the removed position afterwards
+        template<typename NodePointer>
+        std::pair<NodePointer, NodePointer> Unlink(NodePointer& root, NodePointer node) {
+            NodePointer child = nullptr;
+            NodePointer child_parent = nullptr;
+
+            if (node->left == nullptr) {
+                child = node->right;
+                child_parent = node->parent;
+                Transplant(root, node, node->right);
+            } else if (node->right == nullptr) {
+                child = node->left;
+                child_parent = node->parent;
+                Transplant(root, node, node->left);
+            } else {
+                NodePointer successor = node->right;
+                while (successor->left != nullptr) {
+                    successor = successor->left;
+                }
+
+                child = successor->right;
+                if (successor->parent == node) {
+                    child_parent = successor;
+                } else {
+                    child_parent = successor->parent;
+                    Transplant(root, successor, successor->right);
+                    successor->right = node->right;
+                    successor->right->parent = successor;
+                }
+
+                Transplant(root, node, successor);
+                successor->left = node->left;
+                successor->left->parent = successor;
+                successor->SwapData(*node);
+            }
+
+            node->left = nullptr;
+            node->right = nullptr;
+            node->parent = nullptr;
+
+            if constexpr (std::remove_pointer_t<NodePointer>::kAggregatesSubtree) {
+                RefreshPath(child_parent);
+            }
+
+            return std::make_pair(child, child_parent);
+        }
+    }
+
+    struct NoBalancing {
+        using policy_category = BalancingPolicyTag;
+        using node_data = void;
+
+        template<typename NodePointer>
+        static void RebalanceAfterInsert(NodePointer& root, NodePointer node) {}
+
+        template<typename NodePointer>
+        static void Erase(NodePointer& root, NodePointer node) {
+            detail::Unlink(root, node);
+        }
+
+        template<typename NodePointer>
+        static void MarkBalancedNode(NodePointer node, std::size_t depth, std::size_t complete_levels) {}
+
+        template<typename NodePointer>
+        static void NormalizeRoot(NodePointer root) {}
+
+        // Join(left, pivot, right) links two plain trees below pivot, all keys of left are smaller than
+        // pivot and all keys of right larger. Balanced policies descend the taller tree to a subtree
+        // matching the shorter one, so a join costs O(|height(left) - height(right)| + 1)
+        template<typename NodePointer>
+        static NodePointer Join(NodePointer left, NodePointer pivot, NodePointer right) {
+            return detail::LinkPivot(left, pivot, right);
+        }
+    };
+
+    struct RedBlackNodeData {
+        bool is_red = true;
+
+        template<typename NodeType>
+        void Refresh(const NodeType& node) {}
+    };
+
+    struct RedBlackBalancing {
+        using policy_category = BalancingPolicyTag;
+        using node_data = RedBlackNodeData;
+
+        template<typename NodePointer>
+        static void RebalanceAfterInsert(NodePointer& root, NodePointer node) {
+            node->is_red = true;
+
+            while (node->parent != nullptr && node->parent->is_red) {
+                NodePointer parent = node->parent;
+                NodePointer grandparent = parent->parent;
+
+                if (parent == grandparent->left) {
+                    NodePointer uncle = grandparent->right;
+                    if (IsRed(uncle)) {
+                        parent->is_red = false;
+                        uncle->is_red = false;
+                        grandparent->is_red = true;
+                        node = grandparent;
+                    } else {
+                        if (node == parent->right) {
+                            node = parent;
+                            detail::RotateLeft(root, node);
+                            parent = node->parent;
+                        }
+                        parent->is_red = false;
+                        grandparent->is_red = true;
+                        detail::RotateRight(root, grandparent);
+                    }
+                } else {
+                    NodePointer uncle = grandparent->left;
+                    if (IsRed(uncle)) {
+                        parent->is_red = false;
+                        uncle->is_red = false;
+                        grandparent->is_red = true;
+                        node = grandparent;
+                    } else {
+                        if (node == parent->left) {
+                            node = parent;
+                            detail::RotateRight(root, node);
+                            parent = node->parent;
+                        }
+                        parent->is_red = false;
+                        grandparent->is_red = true;
+                        detail::RotateLeft(root, grandparent);
+                    }
+                }
+            }
+
+            root->is_red = false;
+        }
+
+        template<typename NodePointer>
+        static void Erase(NodePointer& root, NodePointer node) {
+            auto [child, parent] = detail::Unlink(root, node);
+
+            if (node->is_red) return;
+
+            while (child != root && !IsRed(child)) {
+                if (child == parent->left) {
+                    NodePointer sibling = parent->right;
+                    if (sibling->is_red) {
+                        sibling->is_red = false;
+                        parent->is_red = true;
+                        detail::RotateLeft(root, parent);
+                        sibling = parent->right;
+                    }
+
+                    if (!IsRed(sibling->left) && !IsRed(sibling->right)) {
+                        sibling->is_red = true;
+                        child = parent;
+                        parent = parent->parent;
+                    } else {
+                        if (!IsRed(sibling->right)) {
+                            sibling->left->is_red = false;
+                            sibling->is_red = true;
+                            detail::RotateRight(root, sibling);
+                            sibling = parent->right;
+                        }
+                        sibling->is_red = parent->is_red;
+                        parent->is_red = false;
+                        sibling->right->is_red = false;
+                        detail::RotateLeft(root, parent);
+                        child = root;
+                    }
+                } else {
+                    NodePointer sibling = parent->left;
+                    if (sibling->is_red) {
+                        sibling->is_red = false;
+                        parent->is_red = true;
+                        detail::RotateRight(root, parent);
+                        sibling = parent->left;
+                    }
+
+                    if (!IsRed(sibling->left) && !IsRed(sibling->right)) {
+                        sibling->is_red = true;
+                        child = parent;
+                        parent = parent->parent;
+                    } else {
+                        if (!IsRed(sibling->left)) {
+                            sibling->right->is_red = false;
+                            sibling->is_red = true;
+                            detail::RotateLeft(root, sibling);
+                            sibling = parent->left;
+                        }
+                        sibling->is_red = parent->is_red;
+                        parent->is_red = false;
+                        sibling->left->is_red = false;
+                        detail::RotateRight(root, parent);
+                        child = root;
+                    }
+                }
+            }
+
+            if (child != nullptr) {
+                child->is_red = false;
+            }
+        }
+
+        // In a bulk-built tree every level but the last is complete: only the nodes of an incomplete
+        // last level are red, so all paths carry the same number of black nodes
+        template<typename NodePointer>
+        static void MarkBalancedNode(NodePointer node, std::size_t depth, std::size_t complete_levels) {
+            node->is_red = (depth == complete_levels);
+        }
+
+        // A subtree cut loose by a split or a set operation may have a red root, which would leave the
+        // insert fix-up a red parent without a grandparent. Blackening it keeps every path balanced
+        template<typename NodePointer>
+        static void NormalizeRoot(NodePointer root) {
+            if (root != nullptr) {
+                root->is_red = false;
+            }
+        }
+
+        // Both roots turn black (still valid), then pivot goes in red on the spine of the taller tree next
+        // to a black subtree of the shorter tree's black height and the insert fix-up repairs the colours
+        template<typename NodePointer>
+        static NodePointer Join(NodePointer left, NodePointer pivot, NodePointer right) {
+            if (left != nullptr) {
+                left->is_red = false;
+            }
+            if (right != nullptr) {
+                right->is_red = false;
+            }
+
+            int left_black_height = BlackHeight(left);
+            int right_black_height = BlackHeight(right);
+            if (left_black_height == right_black_height) {
+                detail::LinkPivot(left, pivot, right);
+                pivot->is_red = false;
+
+                return pivot;
+            }
+
+            bool left_taller = left_black_height > right_black_height;
+            NodePointer root = left_taller ? left : right;
+            NodePointer parent = nullptr;
+            NodePointer node = root;
+            int black_height = std::max(left_black_height, right_black_height);
+            int target_black_height = std::min(left_black_height, right_black_height);
+            while (IsRed(node) || black_height > target_black_height) {
+                if (!IsRed(node)) {
+                    --black_height;
+                }
+                parent = node;
+                node = left_taller ? node->right : node->left;
+            }
+
+            if (left_taller) {
+                detail::LinkPivot(node, pivot, right);
+                parent->right = pivot;
+            } else {
+                detail::LinkPivot(left, pivot, node);
+                parent->left = pivot;
+            }
+            pivot->parent = parent;
+
+            if constexpr (std::remove_pointer_t<NodePointer>::kAggregatesSubtree) {
+                detail::RefreshPath(parent);
+            }
+            RebalanceAfterInsert(root, pivot);
+
+            return root;
+        }
+    private:
+        template<typename NodePointer>
+        static bool IsRed(NodePointer node) {
+            return node != nullptr && node->is_red;
+        }
+
+        template<typename NodePointer>
+        static int BlackHeight(NodePointer node) {
+            int black_height = 0;
+            for (; node != nullptr; node = node->left) {
+                black_height += !node->is_red;
+            }
+
+            return black_height;
+        }
+    };
+
+    struct AvlNodeData {
+        std::int8_t height = 1;
+
+        template<typename NodeType>
+        void Refresh(const NodeType& node) {
+            std::int8_t left_height = (node.left == nullptr) ? 0 : node.left->height;
+            std::int8_t right_height = (node.right == nullptr) ? 0 : node.right->height;
+            height = static_cast<std::int8_t>(std::max(left_height, right_height) + 1);
+        }
+    };
+
+    struct AvlBalancing {
+        using policy_category = BalancingPolicyTag;
+        using node_data = AvlNodeData;
+
+        template<typename NodePointer>
+        static void RebalanceAfterInsert(NodePointer& root, NodePointer node) {
+            node->height = 1;
+            RebalancePath(root, node->parent);
+        }
+
+        template<typename NodePointer>
+        static void Erase(NodePointer& root, NodePointer node) {
+            NodePointer parent = detail::Unlink(root, node).second;
+            RebalancePath(root, parent);
+        }
+
+        // Heights are filled in by RefreshData as the bulk build links the subtrees
+        template<typename NodePointer>
+        static void MarkBalancedNode(NodePointer node, std::size_t depth, std::size_t complete_levels) {}
+
+        template<typename NodePointer>
+        static void NormalizeRoot(NodePointer root) {}
+
+        // pivot goes in on the spine of the taller tree above the first subtree at most one level taller
+        // than the shorter tree, which unbalances the path like an insert does
+        template<typename NodePointer>
+        static NodePointer Join(NodePointer left, NodePointer pivot, NodePointer right) {
+            int left_height = Height(left);
+            int right_height = Height(right);
+            if (std::abs(left_height - right_height) <= 1) return detail::LinkPivot(left, pivot, right);
+
+            bool left_taller = left_height > right_height;
+            NodePointer root = left_taller ? left : right;
+            NodePointer parent = nullptr;
+            NodePointer node = root;
+            int target_height = std::min(left_height, right_height) + 1;
+            while (Height(node) > target_height) {
+                parent = node;
+                node = left_taller ? node->right : node->left;
+            }
+
+            if (left_taller) {
+                detail::LinkPivot(node, pivot, right);
+                parent->right = pivot;
+            } else {
+                detail::LinkPivot(left, pivot, node);
+                parent->left = pivot;
+            }
+            pivot->parent = parent;
+            RebalancePath(root, parent);
+
+            return root;
+        }
+    private:
+        template<typename NodePointer>
+        static int Height(NodePointer node) {
+            return (node == nullptr) ? 0 : node->height;
+        }
+
+        template<typename NodePointer>
+        static int BalanceFactor(NodePointer node) {
+            int left_height = (node->left == nullptr) ? 0 : node->left->height;
+            int right_height = (node->right == nullptr) ? 0 : node->right->height;
+
+            return left_height - right_height;
+        }
+
+        template<typename NodePointer>
+        static void RebalancePath(NodePointer& root, NodePointer node) {
+            while (node != nullptr) {
+                node->RefreshData();
+                int balance = BalanceFactor(node);
+
+                if (balance > 1) {
+                    if (BalanceFactor(node->left) < 0) {
+                        detail::RotateLeft(root, node->left);
+                    }
+                    detail::RotateRight(root, node);
+                    node = node->parent;
+                } else if (balance < -1) {
+                    if (BalanceFactor(node->right) > 0) {
+                        detail::RotateRight(root, node->right);
+                    }
+                    detail::RotateLeft(root, node);
+                    node = node->parent;
+                }
+
+                node = node->parent;
+            }
+        }
+    };
+}
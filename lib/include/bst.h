@@ -1,24 +1,96 @@
+#pragma once
+#include "augmentation.h"
+#include "balancing.h"
+#include "keys.h"
 #include "node.h"
+#include "policy.h"
+#include "slab_allocator.h"
+#include "statistics.h"
+#include <algorithm>
+#include <bit>
+#include <concepts>
 #include <iostream>
+#include <iterator>
 #include <memory>
 #include <numeric>
 #include <vector> // FOR TRAVERSAL TESTING
 
+// Checked iterators throw on stepping outside [begin, end] or dereferencing a null iterator. They are on unless
+// NDEBUG is defined, BST_CHECKED_ITERATORS=0/1 overrides that
+#ifndef BST_CHECKED_ITERATORS
+#ifdef NDEBUG
+#define BST_CHECKED_ITERATORS 0
+#else
+#define BST_CHECKED_ITERATORS 1
+#endif
+#endif
+
 namespace BST {
+    inline constexpr bool kCheckedIterators = BST_CHECKED_ITERATORS;
+
     struct PreOrderTraversal {};
 
     struct InOrderTraversal {};
 
     struct PostOrderTraversal {};
 
-    template<typename Key, typename TraversalTag, typename Comparator = std::less<Key>, typename Allocator = std::allocator<Node<Key>>>
+    // Tag telling bulk operations that the input is strictly increasing (mirrors std::sorted_unique)
+    struct sorted_unique_t {
+        explicit sorted_unique_t() = default;
+    };
+
+    inline constexpr sorted_unique_t sorted_unique{};
+
+    template<typename It>
+    concept LegacyInputIterator = requires {
+        typename std::iterator_traits<It>::iterator_category;
+    } && std::derived_from<typename std::iterator_traits<It>::iterator_category, std::input_iterator_tag>;
+
+    template<typename It>
+    concept LegacyForwardIterator = LegacyInputIterator<It>
+            && std::derived_from<typename std::iterator_traits<It>::iterator_category, std::forward_iterator_tag>;
+
+    template<typename It>
+    concept LegacyRandomAccessIterator = LegacyForwardIterator<It>
+            && std::derived_from<typename std::iterator_traits<It>::iterator_category, std::random_access_iterator_tag>;
+
+    // Comparators declaring is_transparent (e.g. std::less<>) enable lookup by any type comparable with Key
+    template<typename Comparator>
+    concept TransparentComparator = requires { typename Comparator::is_transparent; };
+
+    // erase/extract also take iterators, a heterogeneous key must not be mistaken for one
+    template<typename K, typename Comparator, typename Iterator, typename ConstIterator>
+    concept HeterogeneousKey = TransparentComparator<Comparator>
+            && !std::is_convertible_v<const K&, Iterator> && !std::is_convertible_v<const K&, ConstIterator>;
+
+    namespace detail {
+        struct ParallelTreeAccess;
+        struct SnapshotFileAccess;
+        struct MapTreeAccess;
+    }
+
+    // Policies: at most one balancing policy (NoBalancing by default, RedBlackBalancing, AvlBalancing),
+    // at most one augmentation policy (NoAugmentation by default, OrderStatistics), at most one
+    // statistics policy (NoStatistics by default, CollectStatistics) and at most one key policy
+    // (UniqueKeys by default, EquivalentKeys)
+    template<typename Key, typename TraversalTag, typename Comparator = std::less<Key>, typename Allocator = std::allocator<Node<Key>>, typename... Policies>
     class BinarySearchTree {
     public:
+        using balancing_policy = typename SelectPolicy<BalancingPolicyTag, NoBalancing, Policies...>::type;
+        using augmentation_policy = typename SelectPolicy<AugmentationPolicyTag, NoAugmentation, Policies...>::type;
+        using statistics_policy = typename SelectPolicy<StatisticsPolicyTag, NoStatistics, Policies...>::type;
+        using key_policy = typename SelectPolicy<KeyPolicyTag, UniqueKeys, Policies...>::type;
+        using tree_node_type = typename AppendNodeData<Node<Key>, typename balancing_policy::node_data,
+                typename augmentation_policy::node_data>::type;
+        static constexpr bool kHasOrderStatistics = std::is_base_of_v<SubtreeSizeNodeData, tree_node_type>;
+        static constexpr bool kCollectsStatistics = statistics_policy::recorder::kEnabled;
+        static constexpr bool kAllowsEquivalentKeys = key_policy::kAllowsEquivalentKeys;
+
         template<bool IsConst>
         class Iterator {
         public:
             using key_type = Key;
-            using value_type = Node<Key>;
+            using value_type = tree_node_type;
             using pointer = value_type*;
             using const_pointer = const value_type*;
             using reference = value_type&;
@@ -34,13 +106,20 @@ namespace BST {
 
             Iterator() = default;
 
-            explicit Iterator(pointer node, traversal_tag tag, pointer begin_ptr, pointer end_ptr) : node_ptr_(node), tag_(tag), begin_ptr_(begin_ptr), end_ptr_(end_ptr) {};
-
-            Iterator(const Iterator& other) : node_ptr_(other.node_ptr_), tag_(other.tag_), begin_ptr_(other.begin_ptr_), end_ptr_(other.end_ptr_) {};
-
-            Iterator(Iterator&& other) noexcept = default;
+            explicit Iterator(pointer node, pointer begin_ptr, pointer end_ptr) : node_ptr_(node) {
+                if constexpr (kCheckedIterators) {
+                    bounds_.begin_ptr = begin_ptr;
+                    bounds_.end_ptr = end_ptr;
+                }
+            };
 
-            ~Iterator() = default;
+            template<bool OtherConst> requires (IsConst && !OtherConst)
+            Iterator(const Iterator<OtherConst>& other) : node_ptr_(other.node_ptr_) {
+                if constexpr (kCheckedIterators) {
+                    bounds_.begin_ptr = other.bounds_.begin_ptr;
+                    bounds_.end_ptr = other.bounds_.end_ptr;
+                }
+            };
 
             bool operator==(const Iterator& rhs_iter) const {
                 return node_ptr_ == rhs_iter.node_ptr_;
@@ -50,22 +129,12 @@ namespace BST {
                 return !(operator==(rhs_iter));
             }
 
-            Iterator& operator=(const Iterator& rhs) {
-                if (*this != rhs) Iterator(rhs).swap(*this);
-
-                return *this;
-            }
-
-            Iterator& operator=(Iterator&& rhs) noexcept {
-                swap(rhs);
-
-                return *this;
-            }
-
             Iterator& operator++() {
-                if (node_ptr_ == end_ptr_) throw std::out_of_range("Iterator is out of range");
+                if constexpr (kCheckedIterators) {
+                    if (node_ptr_ == bounds_.end_ptr) throw std::out_of_range("Iterator is out of range");
+                }
 
-                Increment(tag_);
+                Increment();
 
                 return *this;
             }
@@ -78,9 +147,11 @@ namespace BST {
             }
 
             Iterator& operator--() {
-                if (node_ptr_== begin_ptr_) throw std::out_of_range("Iterator is out of range");
+                if constexpr (kCheckedIterators) {
+                    if (node_ptr_ == bounds_.begin_ptr) throw std::out_of_range("Iterator is out of range");
+                }
 
-                Decrement(tag_);
+                Decrement();
 
                 return *this;
             }
@@ -93,153 +164,161 @@ namespace BST {
             }
 
             conditional_key_ref operator*() const {
-                ValidateIterator();
+                if constexpr (kCheckedIterators) {
+                    if (node_ptr_ == nullptr) throw std::runtime_error("Invalid iterator");
+                }
 
                 return node_ptr_->value;
             }
 
             void swap(Iterator& rhs) {
                 std::swap(node_ptr_, rhs.node_ptr_);
-                std::swap(begin_ptr_, rhs.begin_ptr_);
-                std::swap(end_ptr_, rhs.end_ptr_);
-                std::swap(tag_, rhs.tag_);
+                std::swap(bounds_, rhs.bounds_);
             }
 
             friend void swap(Iterator& lhs, Iterator& rhs) {
                 lhs.swap(rhs);
             }
         private:
+            // Checked iterators remember the container bounds to reject stepping past them, otherwise
+            // the bounds are an empty member and the iterator is a single node pointer
+            struct CheckedBounds {
+                conditional_ptr begin_ptr = nullptr;
+                conditional_ptr end_ptr = nullptr;
+            };
+
+            struct UncheckedBounds {};
+
             conditional_ptr node_ptr_ = nullptr;
-            conditional_ptr begin_ptr_ = nullptr;
-            conditional_ptr end_ptr_ = nullptr;
-            traversal_tag tag_;
+            [[no_unique_address]] std::conditional_t<kCheckedIterators, CheckedBounds, UncheckedBounds> bounds_;
 
-            void ValidateIterator() const {
-                if (node_ptr_ == nullptr) throw std::runtime_error("Invalid iterator");
-            }
+            friend class BinarySearchTree;
+            friend struct detail::ParallelTreeAccess;
 
-            void Increment(PreOrderTraversal tag) {
-                if (node_ptr_->left != nullptr) {
-                    node_ptr_ = node_ptr_->left;
-                } else if (node_ptr_->right != nullptr) {
-                    node_ptr_ = node_ptr_->right;
-                } else {
-                    if (node_ptr_->parent == nullptr) {
+            template<bool>
+            friend class Iterator;
+
+            // The end_ptr_ sentinel is wired into the tree (right child of the maximum for pre/in-order,
+            // parent of the root for post-order), so both walks reach and leave end() without knowing it
+            void Increment() {
+                if constexpr (std::is_same_v<traversal_tag, PreOrderTraversal>) {
+                    if (node_ptr_->left != nullptr) {
+                        node_ptr_ = node_ptr_->left;
+                    } else if (node_ptr_->right != nullptr) {
                         node_ptr_ = node_ptr_->right;
                     } else {
-                        conditional_ptr temp_node = node_ptr_->parent;
-                        conditional_ptr prev_node = node_ptr_;
-                        while (temp_node->right == nullptr || temp_node->right == prev_node) {
-                            prev_node = temp_node;
-                            temp_node = temp_node->parent;
+                        if (node_ptr_->parent == nullptr) {
+                            node_ptr_ = node_ptr_->right;
+                        } else {
+                            conditional_ptr temp_node = node_ptr_->parent;
+                            conditional_ptr prev_node = node_ptr_;
+                            while (temp_node->right == nullptr || temp_node->right == prev_node) {
+                                prev_node = temp_node;
+                                temp_node = temp_node->parent;
+                            }
+                            node_ptr_ = temp_node->right;
                         }
-                        node_ptr_ = temp_node->right;
                     }
-                }
-            }
-
-            void Decrement(PreOrderTraversal tag) {
-                if (node_ptr_->parent->left == node_ptr_) {
-                    node_ptr_ = node_ptr_->parent;
-                } else {
-                    if (node_ptr_->parent->left == nullptr) {
-                        node_ptr_ = node_ptr_->parent;
+                } else if constexpr (std::is_same_v<traversal_tag, InOrderTraversal>) {
+                    if (node_ptr_->right != nullptr) {
+                        conditional_ptr temp_node = node_ptr_->right;
+                        while (temp_node->left != nullptr) {
+                            temp_node = temp_node->left;
+                        }
+                        node_ptr_ = temp_node;
                     } else {
-                        conditional_ptr temp_node = node_ptr_->parent->left;
-                        while (temp_node->left != nullptr || temp_node->right != nullptr) {
-                            if (temp_node->right != nullptr) {
-                                temp_node = temp_node->right;
-                            } else {
-                                temp_node = temp_node->left;
+                        if (node_ptr_->parent->left == node_ptr_) {
+                            node_ptr_ = node_ptr_->parent;
+                        } else {
+                            conditional_ptr temp_node = node_ptr_->parent;
+                            conditional_ptr prev_node = node_ptr_;
+                            while (temp_node->right == prev_node) {
+                                prev_node = temp_node;
+                                temp_node = temp_node->parent;
                             }
+                            node_ptr_ = temp_node;
                         }
-                        node_ptr_ = temp_node;
                     }
-                }
-            }
-
-            void Increment(InOrderTraversal tag) {
-                if (node_ptr_->right != nullptr) {
-                    conditional_ptr temp_node = node_ptr_->right;
-                    while (temp_node->left != nullptr) {
-                        temp_node = temp_node->left;
-                    }
-                    node_ptr_ = temp_node;
                 } else {
-                    if (node_ptr_->parent->left == node_ptr_) {
+                    if (node_ptr_->parent->right == node_ptr_) {
                         node_ptr_ = node_ptr_->parent;
                     } else {
                         conditional_ptr temp_node = node_ptr_->parent;
-                        conditional_ptr prev_node = node_ptr_;
-                        while (temp_node->right == nullptr || temp_node->right == prev_node) {
-                            prev_node = temp_node;
-                            temp_node = temp_node->parent;
+                        if (temp_node->right == nullptr) {
+                            node_ptr_ = temp_node;
+                        } else {
+                            temp_node = temp_node->right;
+                            while (temp_node->left != nullptr || temp_node->right != nullptr) {
+                                if (temp_node->left != nullptr) {
+                                    temp_node = temp_node->left;
+                                } else {
+                                    temp_node = temp_node->right;
+                                }
+                            }
+                            node_ptr_ = temp_node;
                         }
-                        node_ptr_ = temp_node;
-                    }
-                }
-            }
-
-            void Decrement(InOrderTraversal tag) {
-                if (node_ptr_->left == nullptr) {
-                    conditional_ptr temp_node = node_ptr_;
-                    while (temp_node->parent->right != temp_node) {
-                        temp_node = temp_node->parent;
                     }
-                    node_ptr_ = temp_node->parent;
-                } else {
-                    conditional_ptr temp_node = node_ptr_->left;
-                    while (temp_node->right != nullptr) {
-                        temp_node = temp_node->right;
-                    }
-                    node_ptr_ = temp_node;
                 }
             }
 
-            void Increment(PostOrderTraversal tag) {
-                if (node_ptr_->parent->right == node_ptr_) {
-                    node_ptr_ = node_ptr_->parent;
-                } else {
-                    conditional_ptr temp_node = node_ptr_->parent;
-                    if (temp_node->right == nullptr) {
-                        node_ptr_ = temp_node;
+            void Decrement() {
+                if constexpr (std::is_same_v<traversal_tag, PreOrderTraversal>) {
+                    if (node_ptr_->parent->left == node_ptr_) {
+                        node_ptr_ = node_ptr_->parent;
                     } else {
-                        temp_node = temp_node->right;
-                        while (temp_node->left != nullptr || temp_node->right != nullptr) {
-                            if (temp_node->left != nullptr) {
-                                temp_node = temp_node->left;
-                            } else {
-                                temp_node = temp_node->right;
+                        if (node_ptr_->parent->left == nullptr) {
+                            node_ptr_ = node_ptr_->parent;
+                        } else {
+                            conditional_ptr temp_node = node_ptr_->parent->left;
+                            while (temp_node->left != nullptr || temp_node->right != nullptr) {
+                                if (temp_node->right != nullptr) {
+                                    temp_node = temp_node->right;
+                                } else {
+                                    temp_node = temp_node->left;
+                                }
                             }
+                            node_ptr_ = temp_node;
+                        }
+                    }
+                } else if constexpr (std::is_same_v<traversal_tag, InOrderTraversal>) {
+                    if (node_ptr_->left == nullptr) {
+                        conditional_ptr temp_node = node_ptr_;
+                        while (temp_node->parent->right != temp_node) {
+                            temp_node = temp_node->parent;
+                        }
+                        node_ptr_ = temp_node->parent;
+                    } else {
+                        conditional_ptr temp_node = node_ptr_->left;
+                        while (temp_node->right != nullptr) {
+                            temp_node = temp_node->right;
                         }
                         node_ptr_ = temp_node;
                     }
-                }
-            }
-
-            void Decrement(PostOrderTraversal tag) {
-                if (node_ptr_->right != nullptr) {
-                    node_ptr_ = node_ptr_->right;
-                } else if (node_ptr_->left != nullptr) {
-                    node_ptr_ = node_ptr_->left;
                 } else {
-                    conditional_ptr temp_node = node_ptr_->parent;
-                    conditional_ptr prev_node = node_ptr_;
-                    while (temp_node->left == nullptr || temp_node->left == prev_node) {
-                        prev_node = temp_node;
-                        temp_node = temp_node->parent;
+                    if (node_ptr_->right != nullptr) {
+                        node_ptr_ = node_ptr_->right;
+                    } else if (node_ptr_->left != nullptr) {
+                        node_ptr_ = node_ptr_->left;
+                    } else {
+                        conditional_ptr temp_node = node_ptr_->parent;
+                        conditional_ptr prev_node = node_ptr_;
+                        while (temp_node->left == nullptr || temp_node->left == prev_node) {
+                            prev_node = temp_node;
+                            temp_node = temp_node->parent;
+                        }
+                        node_ptr_ = temp_node->left;
                     }
-                    node_ptr_ = temp_node->left;
                 }
             }
         };
 
         // AllocatorAwareContainer
         using allocator_type = Allocator;
-        using allocator_traits = std::allocator_traits<allocator_type>;
+        using node_allocator_type = typename std::allocator_traits<allocator_type>::template rebind_alloc<tree_node_type>;
+        using allocator_traits = std::allocator_traits<node_allocator_type>;
 
         // Container
-        using value_type = Node<Key>;
+        using value_type = tree_node_type;
         using pointer = value_type*;
         using const_pointer = const value_type*;
         using reference = value_type&;
@@ -254,7 +333,13 @@ namespace BST {
         using key_type = Key;
         using key_compare = Comparator;
         using value_compare = key_compare;
-        using node_type = NodeWrapper<key_type>;
+        using node_type = NodeWrapper<key_type, allocator_type, tree_node_type>;
+
+        struct insert_return_type {
+            iterator position;
+            bool inserted;
+            node_type node;
+        };
 
         // ReversibleContainer
         using reverse_iterator = std::reverse_iterator<iterator>;
@@ -264,30 +349,51 @@ namespace BST {
             DefaultConstructor();
         }
 
-        BinarySearchTree(const BinarySearchTree& other) : comparator_(other.comparator_), tag_(other.tag_), end_ptr_(other.end_ptr_) {
-            if (other.empty()) DefaultConstructor();
-
-            head_root_ = CopyTree(other.head_root_);
+        // The constructors delegate, so the destructor frees the sentinel and the keys inserted so far when
+        // a copy or an insert throws
+        BinarySearchTree(const BinarySearchTree& other) : BinarySearchTree(node_allocator_type(), other.comparator_) {
+            tag_ = other.tag_;
+            head_root_ = CopyTree(other.head_root_, other.end_ptr_);
+            RefreshMinAndMax();
             UpdateBeginAndEnd(tag_);
         }
 
-        BinarySearchTree(BinarySearchTree&& other) noexcept = default;
-
-        BinarySearchTree(const std::initializer_list<key_type>& values_list) {
-            DefaultConstructor();
+        // The sentinel moves along with the keys, so no allocation happens here and vector reallocation moves
+        // trees instead of copying them. The moved-from tree is empty and makes a new sentinel once keys come back
+        BinarySearchTree(BinarySearchTree&& other) noexcept(std::is_nothrow_copy_constructible_v<key_compare>)
+            : allocator_(other.allocator_), comparator_(other.comparator_), tag_(other.tag_) {
+            swap(other);
+        }
 
+        BinarySearchTree(const std::initializer_list<key_type>& values_list) : BinarySearchTree() {
             insert(values_list);
         }
 
-        BinarySearchTree(iterator it1, iterator it2)  {
-            DefaultConstructor();
-
+        template<LegacyInputIterator InputIt>
+        BinarySearchTree(InputIt it1, InputIt it2) : BinarySearchTree() {
             insert(it1, it2);
         }
 
+        BinarySearchTree(sorted_unique_t tag, const std::initializer_list<key_type>& values_list) : BinarySearchTree() {
+            insert(tag, values_list.begin(), values_list.end());
+        }
+
+        template<LegacyForwardIterator ForwardIt>
+        BinarySearchTree(sorted_unique_t tag, ForwardIt it1, ForwardIt it2) : BinarySearchTree() {
+            insert(tag, it1, it2);
+        }
+
+        // Trivial nodes in a slab pool that only this tree holds go away with the pool, without the walk
         ~BinarySearchTree() {
-            Clear(head_root_);
-            DestroyNode(end_ptr_);
+            if constexpr (std::is_trivially_destructible_v<tree_node_type>
+                          && std::is_same_v<node_allocator_type, SlabAllocator<tree_node_type>>) {
+                if (allocator_.owns_all_blocks()) return;
+            }
+
+            Clear();
+            if (end_ptr_ != nullptr) {
+                DestroyNode(end_ptr_);
+            }
         }
 
         [[nodiscard]] std::vector<key_type> TraversalToVector() const {
@@ -303,31 +409,31 @@ namespace BST {
         }
 
         BinarySearchTree& operator=(const BinarySearchTree& rhs) {
-            if (*this != rhs) BinarySearchTree(rhs).swap(*this);
+            if (this != &rhs) BinarySearchTree(rhs).swap(*this);
 
             return *this;
         }
 
         BinarySearchTree& operator=(BinarySearchTree&& rhs) noexcept {
-            swap(*this);
+            swap(rhs);
 
             return *this;
         }
 
         iterator begin() const {
-            return iterator(begin_ptr_, tag_, begin_ptr_, end_ptr_);
+            return iterator(begin_ptr_, begin_ptr_, end_ptr_);
         }
 
         iterator end() const {
-            return iterator(end_ptr_, tag_, begin_ptr_, end_ptr_);
+            return iterator(end_ptr_, begin_ptr_, end_ptr_);
         }
 
         const_iterator cbegin() const {
-            return const_iterator(begin_ptr_, tag_, begin_ptr_, end_ptr_);
+            return const_iterator(begin_ptr_, begin_ptr_, end_ptr_);
         }
 
         const_iterator cend() const {
-            return const_iterator(end_ptr_, tag_, begin_ptr_, end_ptr_);
+            return const_iterator(end_ptr_, begin_ptr_, end_ptr_);
         }
 
         reverse_iterator rbegin() const {
@@ -354,6 +460,52 @@ namespace BST {
             return tree_size_;
         }
 
+        // Number of nodes on the longest root-to-leaf path, computed iteratively over parent links
+        [[nodiscard]] size_type height() const {
+            size_type max_depth = 0;
+            size_type depth = 1;
+            const_pointer current = head_root_;
+            const_pointer previous = (head_root_ == nullptr) ? nullptr : head_root_->parent;
+            const_pointer stop = previous;
+
+            while (current != stop) {
+                if (previous == current->parent) {
+                    max_depth = std::max(max_depth, depth);
+                    if (!IsEmptyChild(current->left)) {
+                        previous = current;
+                        current = current->left;
+                        ++depth;
+                        continue;
+                    }
+                }
+                if ((previous == current->parent || previous == current->left) && !IsEmptyChild(current->right)) {
+                    previous = current;
+                    current = current->right;
+                    ++depth;
+                    continue;
+                }
+
+                previous = current;
+                current = current->parent;
+                --depth;
+            }
+
+            return max_depth;
+        }
+
+        // Counters since construction or the last reset_stats(). Measuring the height walks the tree, the
+        // rest is copied
+        [[nodiscard]] TreeStatistics stats() const requires kCollectsStatistics {
+            TreeStatistics snapshot = statistics_.counters;
+            snapshot.height = height();
+
+            return snapshot;
+        }
+
+        void reset_stats() requires kCollectsStatistics {
+            statistics_.counters = TreeStatistics{};
+        }
+
         [[nodiscard]] size_type max_size() const {
             return std::numeric_limits<size_type>::max();
         }
@@ -367,102 +519,440 @@ namespace BST {
         }
 
         [[nodiscard]] allocator_type get_allocator() const {
-            return allocator_;
+            return allocator_type(allocator_);
         }
 
+        // The key is constructed inside a new node and searched for from there, so it is never copied or
+        // moved; a duplicate node is destroyed again. A ready key_type goes through insert instead, which
+        // searches before it allocates
         template <typename... Args>
         std::pair<iterator, bool> emplace(Args&&... args) {
-            key_type key_value = Key(std::forward<Args>(args)...);
+            if constexpr (sizeof...(Args) == 1 && (std::is_same_v<std::remove_cvref_t<Args>, key_type> && ...)) {
+                return insert(std::forward<Args>(args)...);
+            } else {
+                pointer new_node = ConstructNodeInPlace(std::forward<Args>(args)...);
+                InsertPosition position = FindInsertPosition(new_node->value);
+                if (position.duplicate != nullptr) {
+                    DestroyNode(new_node);
+                    return std::make_pair(iterator(position.duplicate, begin_ptr_, end_ptr_), false);
+                }
+                AttachNode(new_node, position);
+
+                return std::make_pair(iterator(new_node, begin_ptr_, end_ptr_), true);
+            }
+        }
+
+        // Like emplace, but the new node is attached next to the hint when it fits there (see insert
+        // with a hint), so no descent is needed
+        template <typename... Args>
+        iterator emplace_hint(const_iterator hint, Args&&... args) {
+            if constexpr (sizeof...(Args) == 1 && (std::is_same_v<std::remove_cvref_t<Args>, key_type> && ...)) {
+                return insert(hint, std::forward<Args>(args)...);
+            } else {
+                pointer new_node = ConstructNodeInPlace(std::forward<Args>(args)...);
+                InsertPosition position = FindHintedInsertPosition(const_cast<pointer>(hint.node_ptr_), new_node->value);
+                if (position.duplicate != nullptr) {
+                    DestroyNode(new_node);
+                    return iterator(position.duplicate, begin_ptr_, end_ptr_);
+                }
+                AttachNode(new_node, position);
 
-            return insert(key_value);
+                return iterator(new_node, begin_ptr_, end_ptr_);
+            }
         }
 
-        std::pair<iterator, bool> insert(key_type key_value) {
+        std::pair<iterator, bool> insert(const key_type& key_value) {
             return Insert(key_value);
         }
 
-        void insert(iterator it1, iterator it2) {
+        std::pair<iterator, bool> insert(key_type&& key_value) {
+            return Insert(std::move(key_value));
+        }
+
+        // The hint names the key's place in key order: the key is attached right before or right after
+        // the hinted node with at most two comparisons and no descent, otherwise it is inserted as usual.
+        // end() appends after the maximum and the minimum's iterator prepends, so monotonic streams cost
+        // O(1) per key plus the rebalancing
+        iterator insert(const_iterator hint, const key_type& key_value) {
+            return InsertHinted(const_cast<pointer>(hint.node_ptr_), key_value);
+        }
+
+        iterator insert(const_iterator hint, key_type&& key_value) {
+            return InsertHinted(const_cast<pointer>(hint.node_ptr_), std::move(key_value));
+        }
+
+        // A strictly increasing forward range inserted into an empty in-order tree is bulk-built in O(n).
+        // Pre- and post-order iterate the tree's shape, so they keep the shape one-by-one insertion gives
+        // and are bulk-built only on request (sorted_unique)
+        template<LegacyInputIterator InputIt>
+        void insert(InputIt it1, InputIt it2) {
+            if constexpr (LegacyForwardIterator<InputIt> && std::is_same_v<traversal_tag, InOrderTraversal>) {
+                if (empty() && IsSortedUnique(it1, it2)) {
+                    BuildFromSorted(it1, std::distance(it1, it2));
+                    return;
+                }
+            }
+
+            for (auto it = it1; it != it2; ++it) {
+                insert(cend(), *it);
+            }
+        }
+
+        // The caller guarantees strictly increasing keys, so an empty tree skips the sortedness check and is
+        // built perfectly balanced, whatever the traversal. Otherwise each key is hinted with the previous
+        // one, so keys above the maximum are appended in O(1) and the rest land next to their predecessor
+        template<LegacyForwardIterator ForwardIt>
+        void insert(sorted_unique_t tag, ForwardIt it1, ForwardIt it2) {
+            if (empty()) {
+                BuildFromSorted(it1, std::distance(it1, it2));
+                return;
+            }
+
+            // After the maximum the end() hint checks a single gap, so appending costs one comparison
+            const_iterator hint = cend();
             for (auto it = it1; it != it2; ++it) {
-                insert(*it);
+                iterator inserted = insert(hint, *it);
+                hint = (inserted.node_ptr_ == max_ptr_) ? cend() : const_iterator(inserted);
             }
         }
 
         void insert(const std::initializer_list<key_type>& values_list) {
-            for (auto value : values_list) {
-                insert(value);
+            insert(values_list.begin(), values_list.end());
+        }
+
+        // Links the handle's node back in as is, a duplicate key leaves it in the returned handle. An adopted
+        // node counts as an allocation of this tree, so extract and insert balance out in stats()
+        insert_return_type insert(node_type&& node_handle) {
+            if (node_handle.empty()) return insert_return_type{end(), false, node_type{}};
+            EnsureEnd();
+
+            InsertPosition position = FindInsertPosition(node_handle.value());
+            if (position.duplicate != nullptr) {
+                return insert_return_type{iterator(position.duplicate, begin_ptr_, end_ptr_), false, std::move(node_handle)};
             }
+
+            pointer inserted_node = node_handle.Release();
+            inserted_node->ResetLinks();
+            ++tree_size_;
+            statistics_.RecordAllocations(1);
+            AttachNode(inserted_node, position);
+
+            return insert_return_type{iterator(inserted_node, begin_ptr_, end_ptr_), true, node_type{}};
+        }
+
+        node_type extract(const key_type& key_value) {
+            return Delete(key_value).second;
         }
 
-        node_type extract(key_type key_value) {
+        template<typename K> requires HeterogeneousKey<K, key_compare, iterator, const_iterator>
+        node_type extract(const K& key_value) {
             return Delete(key_value).second;
         }
 
         node_type extract(const_iterator node_iter) {
             if (node_iter == cend()) throw std::runtime_error("Attempt to extract end of container");
 
-            return extract(*node_iter);
+            return DeleteNode(const_cast<pointer>(node_iter.node_ptr_)).second;
+        }
+
+        size_type erase(const key_type& key_value) {
+            return Erase(key_value);
         }
 
-        size_type erase(key_type key_value) {
-            return Delete(key_value).first != end();
+        template<typename K> requires HeterogeneousKey<K, key_compare, iterator, const_iterator>
+        size_type erase(const K& key_value) {
+            return Erase(key_value);
         }
 
         iterator erase(const_iterator node_iter) {
             if (node_iter == cend()) throw std::runtime_error("Attempt to extract end of container");
 
-            return Delete(*node_iter).first;
+            return iterator(EraseNode(const_cast<pointer>(node_iter.node_ptr_)), begin_ptr_, end_ptr_);
         }
 
         iterator erase(iterator node_iter) {
             if (node_iter == end()) throw std::runtime_error("Attempt to extract end of container");
 
-            return Delete(*node_iter).first;
+            return iterator(EraseNode(node_iter.node_ptr_), begin_ptr_, end_ptr_);
         }
 
         iterator erase(const_iterator it1, const_iterator it2) {
-            key_type it2_value = *it2;
-            size_type array_length = std::distance(it1, it2);
-            key_type values_to_delete[array_length];
+            pointer last_node = const_cast<pointer>(it2.node_ptr_);
 
-            for (auto it = it1; it != it2; ++it) {
-                values_to_delete[std::distance(it1, it)] = *it;
+            if (it1 == cbegin() && it2 == cend()) {
+                Clear();
+            } else if (it1 != it2) {
+                EraseRange(const_cast<pointer>(it1.node_ptr_), last_node, tag_);
             }
 
-            for (int i = 0; i < array_length; ++i) {
-                Delete(values_to_delete[i]);
+            return iterator(last_node, begin_ptr_, end_ptr_);
+        }
+
+        // Join-based set algebra. Nodes are spliced between the trees, never copied, so the allocators must
+        // compare equal. On balanced trees the operations take O(m log(n / m + 1)) for sizes m <= n; without
+        // balancing they fall back to walking other in key order, which needs no recursion on degenerate trees.
+        // merge moves the keys missing here out of other and leaves the rest there, as std::set::merge does;
+        // with EquivalentKeys it moves every key, one by one. intersect, subtract and split need unique keys
+        void merge(BinarySearchTree& other) {
+            if (get_allocator() != other.get_allocator()) throw std::runtime_error("Different allocators for merged allocators");
+            if (this == &other) return;
+            EnsureEnd();
+
+            if constexpr (std::is_same_v<balancing_policy, NoBalancing> || kAllowsEquivalentKeys) {
+                // Unlinking relinks nodes without moving them, so the key-order successor taken up front stays valid
+                pointer other_node = other.min_ptr_;
+                while (other_node != nullptr) {
+                    pointer next_node = other.NextInKeyOrder(other_node);
+
+                    InsertPosition position = FindInsertPosition(other_node->value);
+                    if (position.duplicate == nullptr) {
+                        other.UnlinkNode(other_node);
+                        --other.tree_size_;
+                        other_node->ResetLinks();
+                        ++tree_size_;
+                        AttachNode(other_node, position);
+                    }
+
+                    other_node = next_node;
+                }
+            } else {
+                size_type merged_size = tree_size_ + other.tree_size_;
+                size_type duplicate_count = 0;
+                pointer duplicates = nullptr;
+
+                DetachEnd();
+                other.DetachEnd();
+                head_root_ = Union(head_root_, std::exchange(other.head_root_, nullptr), duplicates, duplicate_count);
+                tree_size_ = merged_size - duplicate_count;
+                other.tree_size_ = 0;
+                FinishSplice();
+                other.FinishSplice();
+
+                while (duplicates != nullptr) {
+                    pointer next_duplicate = duplicates->right;
+                    duplicates->ResetLinks();
+                    ++other.tree_size_;
+                    other.AttachNode(duplicates, other.FindInsertPosition(duplicates->value));
+                    duplicates = next_duplicate;
+                }
             }
+        }
 
-            return iterator(Search(it2_value), tag_, begin_ptr_, end_ptr_);
+        void merge(BinarySearchTree&& other) {
+            merge(other);
         }
 
-        void merge(const BinarySearchTree& other) {
-            if (get_allocator() != other.get_allocator()) throw std::runtime_error("Different allocators for merged allocators");
+        // Keeps only the keys also present in other, other is left empty
+        void intersect(BinarySearchTree& other) requires (!kAllowsEquivalentKeys) {
+            if (get_allocator() != other.get_allocator()) throw std::runtime_error("Different allocators for intersected trees");
+            if (this == &other) return;
+
+            if constexpr (std::is_same_v<balancing_policy, NoBalancing>) {
+                pointer node = min_ptr_;
+                while (node != nullptr) {
+                    pointer next_node = NextInKeyOrder(node);
+                    if (!other.contains(node->value)) {
+                        EraseNode(node);
+                    }
+                    node = next_node;
+                }
+                other.clear();
+            } else {
+                DetachEnd();
+                other.DetachEnd();
+                head_root_ = Intersection(head_root_, std::exchange(other.head_root_, nullptr), other);
+                FinishSplice();
+                other.FinishSplice();
+            }
+        }
 
-            insert(other.begin(), other.end());
+        void intersect(BinarySearchTree&& other) requires (!kAllowsEquivalentKeys) {
+            intersect(other);
         }
 
-        iterator find(key_type key_value) const {
-            return iterator(Search(key_value), tag_, begin_ptr_, end_ptr_);
+        // Removes the keys present in other, other is left empty
+        void subtract(BinarySearchTree& other) requires (!kAllowsEquivalentKeys) {
+            if (get_allocator() != other.get_allocator()) throw std::runtime_error("Different allocators for subtracted trees");
+            if (this == &other) {
+                clear();
+                return;
+            }
+
+            if constexpr (std::is_same_v<balancing_policy, NoBalancing>) {
+                for (pointer other_node = other.min_ptr_; other_node != nullptr; other_node = other.NextInKeyOrder(other_node)) {
+                    Erase(other_node->value);
+                }
+                other.clear();
+            } else {
+                DetachEnd();
+                other.DetachEnd();
+                head_root_ = Difference(head_root_, std::exchange(other.head_root_, nullptr), other);
+                FinishSplice();
+                other.FinishSplice();
+            }
+        }
+
+        void subtract(BinarySearchTree&& other) requires (!kAllowsEquivalentKeys) {
+            subtract(other);
+        }
+
+        // Moves the keys not less than key_value into the returned tree. The relinking takes O(log n) on
+        // balanced trees; without OrderStatistics the two sizes are counted by walking both parts in step,
+        // which stops once the smaller part is done
+        BinarySearchTree split(const key_type& key_value) requires (!kAllowsEquivalentKeys) {
+            BinarySearchTree upper(allocator_, comparator_);
+
+            DetachEnd();
+            SplitResult pieces = Split(head_root_, key_value);
+            head_root_ = pieces.left;
+            upper.head_root_ = (pieces.equal == nullptr) ? pieces.right : balancing_policy::Join(static_cast<pointer>(nullptr), pieces.equal, pieces.right);
+
+            size_type lower_size = CountLowerPart(head_root_, upper.head_root_, tree_size_);
+            upper.tree_size_ = tree_size_ - lower_size;
+            tree_size_ = lower_size;
+            FinishSplice();
+            upper.FinishSplice();
+
+            return upper;
+        }
+
+        // Appends the keys of other, which must all be greater than the keys here, and leaves other empty
+        void join(BinarySearchTree& other) {
+            if (get_allocator() != other.get_allocator()) throw std::runtime_error("Different allocators for joined trees");
+            if (this == &other || other.empty()) return;
+            if (!empty() && !Compare(max_ptr_->value, other.min_ptr_->value)) throw std::runtime_error("Joined keys are not ordered");
+            EnsureEnd();
+
+            DetachEnd();
+            other.DetachEnd();
+            head_root_ = JoinTrees(head_root_, std::exchange(other.head_root_, nullptr));
+            tree_size_ += std::exchange(other.tree_size_, 0);
+            FinishSplice();
+            other.FinishSplice();
+        }
+
+        void join(BinarySearchTree&& other) {
+            join(other);
         }
 
-        size_type count(key_type key_value) const {
-            return find(key_value) != end();
+        iterator find(const key_type& key_value) const {
+            return iterator(Search(key_value), begin_ptr_, end_ptr_);
         }
 
-        bool contains(key_type key_value) const {
+        template<typename K> requires TransparentComparator<key_compare>
+        iterator find(const K& key_value) const {
+            return iterator(Search(key_value), begin_ptr_, end_ptr_);
+        }
+
+        // O(log n + k) for k equivalents
+        size_type count(const key_type& key_value) const {
+            return Count(key_value);
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        size_type count(const K& key_value) const {
+            return Count(key_value);
+        }
+
+        bool contains(const key_type& key_value) const {
+            return count(key_value);
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        bool contains(const K& key_value) const {
             return count(key_value);
         }
 
-        iterator lower_bound(key_type key_value) const {
-            return iterator(LowerBound(key_value), tag_, begin_ptr_, end_ptr_);
+        iterator lower_bound(const key_type& key_value) const {
+            return iterator(LowerBound(key_value), begin_ptr_, end_ptr_);
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        iterator lower_bound(const K& key_value) const {
+            return iterator(LowerBound(key_value), begin_ptr_, end_ptr_);
+        }
+
+        iterator upper_bound(const key_type& key_value) const {
+            return iterator(UpperBound(key_value), begin_ptr_, end_ptr_);
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        iterator upper_bound(const K& key_value) const {
+            return iterator(UpperBound(key_value), begin_ptr_, end_ptr_);
+        }
+
+        // The equivalents of a key are adjacent only in key order, hence the in-order restriction
+        std::pair<iterator, iterator> equal_range(const key_type& key_value) const requires std::is_same_v<traversal_tag, InOrderTraversal> {
+            return std::make_pair(lower_bound(key_value), upper_bound(key_value));
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        std::pair<iterator, iterator> equal_range(const K& key_value) const requires std::is_same_v<traversal_tag, InOrderTraversal> {
+            return std::make_pair(lower_bound(key_value), upper_bound(key_value));
+        }
+
+        // Batched lookups for keys sorted in the tree's order, written to results in input order. Each key
+        // is searched from the previous key's lower bound (finger search): the walk climbs parent links
+        // only until the key fits below and descends from there, so m keys spread over n cost
+        // O(m log(n / m)) instead of O(m log n). A key smaller than its predecessor restarts at the root
+        template<std::forward_iterator KeyIt, std::output_iterator<iterator> OutputIt>
+            requires std::same_as<std::iter_value_t<KeyIt>, key_type> || TransparentComparator<key_compare>
+        OutputIt find_batch(KeyIt first, KeyIt last, OutputIt results) const {
+            return LowerBoundBatch(first, last, results, true);
+        }
+
+        template<std::forward_iterator KeyIt, std::output_iterator<iterator> OutputIt>
+            requires std::same_as<std::iter_value_t<KeyIt>, key_type> || TransparentComparator<key_compare>
+        OutputIt lower_bound_batch(KeyIt first, KeyIt last, OutputIt results) const {
+            return LowerBoundBatch(first, last, results, false);
+        }
+
+        // Number of keys less than key_value
+        size_type rank(const key_type& key_value) const requires kHasOrderStatistics {
+            return Rank(key_value);
+        }
+
+        template<typename K> requires TransparentComparator<key_compare> && kHasOrderStatistics
+        size_type rank(const K& key_value) const {
+            return Rank(key_value);
+        }
+
+        // The key_index-th smallest key (from 0), end() when key_index >= size()
+        iterator select(size_type key_index) const requires kHasOrderStatistics {
+            if (key_index >= tree_size_) return end();
+
+            return iterator(SelectInOrder(key_index), begin_ptr_, end_ptr_);
+        }
+
+        // Number of keys in [lower_key, upper_key)
+        size_type count_range(const key_type& lower_key, const key_type& upper_key) const requires kHasOrderStatistics {
+            return CountRange(lower_key, upper_key);
         }
 
-        iterator upper_bound(key_type key_value) const {
-            return iterator(UpperBound(key_value), tag_, begin_ptr_, end_ptr_);
+        template<typename K> requires TransparentComparator<key_compare> && kHasOrderStatistics
+        size_type count_range(const K& lower_key, const K& upper_key) const {
+            return CountRange(lower_key, upper_key);
+        }
+
+        // Counterparts of std::distance/std::advance in the tree's traversal order, O(log n) instead of O(n)
+        template<bool IsConst>
+        difference_type distance(Iterator<IsConst> first, Iterator<IsConst> last) const requires kHasOrderStatistics {
+            return static_cast<difference_type>(IndexOf(const_cast<pointer>(last.node_ptr_), tag_))
+                   - static_cast<difference_type>(IndexOf(const_cast<pointer>(first.node_ptr_), tag_));
+        }
+
+        template<bool IsConst>
+        void advance(Iterator<IsConst>& it, difference_type steps) const requires kHasOrderStatistics {
+            difference_type position = static_cast<difference_type>(IndexOf(const_cast<pointer>(it.node_ptr_), tag_)) + steps;
+            if constexpr (kCheckedIterators) {
+                if (position < 0 || position > static_cast<difference_type>(tree_size_)) throw std::out_of_range("Iterator is out of range");
+            }
+
+            it.node_ptr_ = (position == static_cast<difference_type>(tree_size_)) ? end_ptr_ : NodeAt(position, tag_);
         }
 
         void clear() {
-            erase(cbegin(), cend());
+            Clear();
         }
 
         void swap(BinarySearchTree& rhs) {
@@ -473,70 +963,80 @@ namespace BST {
             std::swap(tag_, rhs.tag_);
             std::swap(begin_ptr_, rhs.begin_ptr_);
             std::swap(end_ptr_, rhs.end_ptr_);
+            std::swap(min_ptr_, rhs.min_ptr_);
+            std::swap(max_ptr_, rhs.max_ptr_);
+            std::swap(statistics_, rhs.statistics_);
         }
 
         friend void swap(BinarySearchTree& lhs, BinarySearchTree& rhs) {
             lhs.swap(rhs);
         }
     private:
+        friend struct detail::ParallelTreeAccess;
+        friend struct detail::SnapshotFileAccess;
+        friend struct detail::MapTreeAccess;
+
         pointer head_root_ = nullptr;
-        allocator_type allocator_;
+        node_allocator_type allocator_;
         key_compare comparator_;
         size_type tree_size_ = 0;
         traversal_tag tag_;
+        [[no_unique_address]] typename statistics_policy::recorder statistics_;
 
         pointer begin_ptr_ = nullptr;
         pointer end_ptr_ = nullptr;
+        pointer min_ptr_ = nullptr;
+        pointer max_ptr_ = nullptr;
+
+        bool IsEmptyChild(const_pointer node) const {
+            return node == nullptr || node == end_ptr_;
+        }
 
         void DefaultConstructor() {
-            end_ptr_ = ConstructNewNode(key_type{});
-            begin_ptr_ = end_ptr_;
-            tree_size_ = 0;
+            EnsureEnd();
         }
 
-        void UpdateBeginAndEnd(PreOrderTraversal tag) {
-            if (head_root_ == nullptr) {
-                end_ptr_->parent = nullptr;
-            } else {
-                pointer temp_node = head_root_;
-                while (temp_node->right != nullptr && temp_node->right != end_ptr_) {
-                    temp_node = temp_node->right;
-                }
-                temp_node->right = end_ptr_;
-                end_ptr_->parent = temp_node;
-            }
+        // Only a moved-from tree lacks the sentinel, and it stays empty until a key is added, so this runs
+        // before anything links nodes in
+        void EnsureEnd() {
+            if (end_ptr_ != nullptr) return;
 
-            if (head_root_ == nullptr) {
-                begin_ptr_ = end_ptr_;
-            } else {
-                begin_ptr_ = head_root_;
-            }
+            end_ptr_ = AllocateNode(key_type{});
+            statistics_.RecordAllocations(1);
+            begin_ptr_ = end_ptr_;
         }
 
-        void UpdateBeginAndEnd(InOrderTraversal tag) {
-            if (head_root_ == nullptr) {
+        void UpdateBeginAndEnd(traversal_tag tag) {
+            UpdateEnd(tag);
+            UpdateBegin(tag);
+        }
+
+        // The sentinel hangs off the cached maximum, so rewiring it is O(1)
+        void UpdateEnd(PreOrderTraversal tag) {
+            if (end_ptr_ == nullptr) return;
+
+            if (max_ptr_ == nullptr) {
                 end_ptr_->parent = nullptr;
             } else {
-                pointer temp_node = head_root_;
-                while (temp_node->right != nullptr && temp_node->right != end_ptr_) {
-                    temp_node = temp_node->right;
-                }
-                temp_node->right = end_ptr_;
-                end_ptr_->parent = temp_node;
+                max_ptr_->right = end_ptr_;
+                end_ptr_->parent = max_ptr_;
             }
+        }
 
-            if (head_root_ == nullptr) {
-                begin_ptr_ = end_ptr_;
+        void UpdateEnd(InOrderTraversal tag) {
+            if (end_ptr_ == nullptr) return;
+
+            if (max_ptr_ == nullptr) {
+                end_ptr_->parent = nullptr;
             } else {
-                pointer temp_node = head_root_;
-                while (temp_node->left != nullptr) {
-                    temp_node = temp_node->left;
-                }
-                begin_ptr_ = temp_node;
+                max_ptr_->right = end_ptr_;
+                end_ptr_->parent = max_ptr_;
             }
         }
 
-        void UpdateBeginAndEnd(PostOrderTraversal) {
+        void UpdateEnd(PostOrderTraversal tag) {
+            if (end_ptr_ == nullptr) return;
+
             end_ptr_->parent = nullptr;
             if (head_root_ == nullptr) {
                 end_ptr_->left = nullptr;
@@ -546,7 +1046,17 @@ namespace BST {
                 end_ptr_->right = head_root_;
                 head_root_->parent = end_ptr_;
             }
+        }
+
+        void UpdateBegin(PreOrderTraversal tag) {
+            begin_ptr_ = (head_root_ == nullptr) ? end_ptr_ : head_root_;
+        }
 
+        void UpdateBegin(InOrderTraversal tag) {
+            begin_ptr_ = (min_ptr_ == nullptr) ? end_ptr_ : min_ptr_;
+        }
+
+        void UpdateBegin(PostOrderTraversal tag) {
             if (head_root_ == nullptr) {
                 begin_ptr_ = end_ptr_;
             } else {
@@ -562,270 +1072,967 @@ namespace BST {
             }
         }
 
-        std::pair<iterator, bool> Insert(key_type key_value) {
-            pointer inserted_node = Search(key_value);
+        void RefreshMinAndMax() {
+            min_ptr_ = (head_root_ == nullptr) ? nullptr : Leftmost(head_root_);
+            max_ptr_ = (head_root_ == nullptr) ? nullptr : Rightmost(head_root_);
+        }
 
-            if (inserted_node != end_ptr_) return std::make_pair(iterator(inserted_node, tag_, begin_ptr_, end_ptr_), false);
+        pointer Leftmost(pointer root) const {
+            while (root->left != nullptr) {
+                root = root->left;
+            }
 
-            if (head_root_ == nullptr) {
-                head_root_ = ConstructNewNode(key_value);
-                inserted_node = head_root_;
+            return root;
+        }
+
+        pointer Rightmost(pointer root) const {
+            while (!IsEmptyChild(root->right)) {
+                root = root->right;
+            }
+
+            return root;
+        }
+
+        // Searches with the caller's key and copies or moves it into the node only when it is new
+        template<typename K>
+        std::pair<iterator, bool> Insert(K&& key_value) {
+            auto [node, inserted] = TryEmplace(key_value, std::forward<K>(key_value));
+
+            return std::make_pair(iterator(node, begin_ptr_, end_ptr_), inserted);
+        }
+
+        template<typename K>
+        iterator InsertHinted(pointer hint, K&& key_value) {
+            InsertPosition position = FindHintedInsertPosition(hint, key_value);
+            if (position.duplicate != nullptr) return iterator(position.duplicate, begin_ptr_, end_ptr_);
+
+            pointer inserted_node = ConstructNewNode(std::forward<K>(key_value));
+            AttachNode(inserted_node, position);
+
+            return iterator(inserted_node, begin_ptr_, end_ptr_);
+        }
+
+        struct InsertPosition {
+            pointer parent = nullptr;
+            pointer duplicate = nullptr;
+            bool attach_left = false;
+            bool first_in_post_order = true;
+        };
+
+        template<typename A, typename B>
+        bool Compare(const A& lhs, const B& rhs) const {
+            statistics_.RecordComparison();
+
+            return comparator_(lhs, rhs);
+        }
+
+        // Single descent with one comparison per level. The last node the descent turned right at is the
+        // in-order predecessor of the attach position, so one more comparison against it detects a duplicate.
+        // Equivalent keys turn right too, so with EquivalentKeys a new key lands after its equivalents
+        template<typename K>
+        InsertPosition FindInsertPosition(const K& key_value) const {
+            InsertPosition position;
+            pointer predecessor = nullptr;
+            pointer temp_root = head_root_;
+            size_type depth = 0;
+
+            while (!IsEmptyChild(temp_root)) {
+                ++depth;
+                position.parent = temp_root;
+                position.attach_left = Compare(key_value, temp_root->value);
+                if (position.attach_left) {
+                    temp_root = temp_root->left;
+                } else {
+                    position.first_in_post_order = position.first_in_post_order && temp_root->left == nullptr;
+                    predecessor = temp_root;
+                    temp_root = temp_root->right;
+                }
+            }
+
+            if constexpr (!kAllowsEquivalentKeys) {
+                if (predecessor != nullptr && !Compare(predecessor->value, key_value)) {
+                    position.duplicate = predecessor;
+                }
+            }
+            statistics_.RecordPath(TreeOperation::kInsert, depth);
+
+            return position;
+        }
+
+        // A key may follow node when it is greater, or with EquivalentKeys not less, so equivalents keep
+        // their insertion order
+        template<typename K>
+        bool FitsAfter(pointer node, const K& key_value) const {
+            return kAllowsEquivalentKeys ? !Compare(key_value, node->value) : Compare(node->value, key_value);
+        }
+
+        // Checks the gap before and the gap after the hinted node in key order. Of two neighbours in key
+        // order either the lower has no right child or the upper has no left child, so a gap that fits
+        // always has a free slot for the key
+        template<typename K>
+        InsertPosition FindHintedInsertPosition(pointer hint, const K& key_value) const {
+            InsertPosition position;
+            size_type compared_nodes = 1;
+
+            if (hint == end_ptr_) {
+                if (max_ptr_ == nullptr) {
+                    statistics_.RecordPath(TreeOperation::kInsert, 0);
+                    return position;
+                }
+                if (!FitsAfter(max_ptr_, key_value)) return FindInsertPosition(key_value);
+
+                position.parent = max_ptr_;
+            } else if (Compare(key_value, hint->value)) {
+                pointer previous = (hint == min_ptr_) ? nullptr : PreviousInKeyOrder(hint);
+                if (previous != nullptr) {
+                    ++compared_nodes;
+                    if (!FitsAfter(previous, key_value)) return FindInsertPosition(key_value);
+                }
+
+                position.parent = (hint->left == nullptr) ? hint : previous;
+                position.attach_left = position.parent == hint;
             } else {
-                pointer temp_root = head_root_;
-                while (temp_root != nullptr && temp_root != end_ptr_) {
-                    if (comparator_(temp_root->value, key_value)) {
-                        if (temp_root->right != nullptr && temp_root->right != end_ptr_) {
-                            temp_root = temp_root->right;
-                        } else {
-                            pointer new_node = ConstructNewNode(key_value);
-                            new_node->parent = temp_root;
-                            temp_root->right = new_node;
-                            inserted_node = new_node;
-                            break;
-                        }
-                    } else {
-                        if (temp_root->left != nullptr) {
-                            temp_root = temp_root->left;
-                        } else {
-                            pointer new_node = ConstructNewNode(key_value);
-                            new_node->parent = temp_root;
-                            temp_root->left = new_node;
-                            inserted_node = new_node;
-                            break;
-                        }
-                    }
+                if (!FitsAfter(hint, key_value)) return FindInsertPosition(key_value);
+                pointer next = (hint == max_ptr_) ? nullptr : NextInKeyOrder(hint);
+                if (next != nullptr) {
+                    ++compared_nodes;
+                    if (!Compare(key_value, next->value)) return FindInsertPosition(key_value);
                 }
+
+                position.parent = IsEmptyChild(hint->right) ? hint : next;
+                position.attach_left = position.parent != hint;
             }
 
-            UpdateBeginAndEnd(tag_);
+            if constexpr (std::is_same_v<traversal_tag, PostOrderTraversal> && std::is_same_v<balancing_policy, NoBalancing>) {
+                position.first_in_post_order = StartsPostOrder(position.parent, position.attach_left);
+            }
+            statistics_.RecordPath(TreeOperation::kInsert, compared_nodes);
 
-            return std::make_pair(iterator(inserted_node, tag_, begin_ptr_, end_ptr_), true);
+            return position;
         }
 
-        std::pair<iterator, node_type> Delete(key_type key_value) {
-            pointer delete_node = Search(key_value);
+        // A new leaf starts the post-order traversal when it hangs below the current first node, or when
+        // it becomes the left child of a node on the path leading there
+        bool StartsPostOrder(pointer parent, bool attach_left) const {
+            if (parent == begin_ptr_) return true;
+            if (!attach_left || parent->right == nullptr) return false;
+
+            for (pointer child = parent, node = parent->parent; node != end_ptr_; child = node, node = node->parent) {
+                if (node->right == child && node->left != nullptr) return false;
+            }
+
+            return true;
+        }
+
+        void AttachNode(pointer inserted_node, const InsertPosition& position) {
+            pointer parent = position.parent;
+            bool attach_left = position.attach_left;
+
+            DetachEnd();
+
+            inserted_node->parent = parent;
+            if (parent == nullptr) {
+                head_root_ = inserted_node;
+            } else if (attach_left) {
+                parent->left = inserted_node;
+            } else {
+                parent->right = inserted_node;
+            }
+
+            if (min_ptr_ == nullptr || (attach_left && parent == min_ptr_)) {
+                min_ptr_ = inserted_node;
+            }
+            if (max_ptr_ == nullptr || (!attach_left && parent == max_ptr_)) {
+                max_ptr_ = inserted_node;
+            }
+
+            if constexpr (tree_node_type::kAggregatesSubtree) {
+                detail::RefreshPath(parent);
+            }
+
+            balancing_policy::RebalanceAfterInsert(head_root_, inserted_node);
+            UpdateEnd(tag_);
+
+            // Without rotations the new leaf starts the post-order traversal only if the descent kept to its
+            // leftmost-deepest path, so the post-order begin needs no walk either
+            if constexpr (std::is_same_v<traversal_tag, PostOrderTraversal> && std::is_same_v<balancing_policy, NoBalancing>) {
+                if (position.first_in_post_order) {
+                    begin_ptr_ = inserted_node;
+                }
+            } else {
+                UpdateBegin(tag_);
+            }
+        }
+
+        template<typename K>
+        size_type Erase(const K& key_value) {
+            pointer delete_node = Search(key_value, TreeOperation::kErase);
+
+            if (delete_node == end_ptr_) return 0;
+
+            if constexpr (kAllowsEquivalentKeys) {
+                // Search found the first equivalent; erasing relinks nodes without moving them, so each
+                // key-order successor taken before an erase stays valid and no second search is needed
+                size_type erased_count = 0;
+                while (delete_node != nullptr && !Compare(key_value, delete_node->value)) {
+                    pointer next_node = NextInKeyOrder(delete_node);
+                    EraseNode(delete_node);
+                    ++erased_count;
+                    delete_node = next_node;
+                }
+
+                return erased_count;
+            }
+
+            EraseNode(delete_node);
+
+            return 1;
+        }
+
+        template<typename K>
+        size_type Count(const K& key_value) const {
+            pointer node = Search(key_value);
+            if (node == end_ptr_) return 0;
+            if constexpr (!kAllowsEquivalentKeys) return 1;
+
+            size_type equivalent_count = 0;
+            for (; node != nullptr && !Compare(key_value, node->value); node = NextInKeyOrder(node)) {
+                ++equivalent_count;
+            }
+
+            return equivalent_count;
+        }
+
+        template<typename K>
+        std::pair<iterator, node_type> Delete(const K& key_value) {
+            pointer delete_node = Search(key_value, TreeOperation::kErase);
 
             if (delete_node == end_ptr_) return std::make_pair(end(), node_type{});
 
-            key_type next_traversal_node_value = *(++iterator(delete_node, tag_, begin_ptr_, end_ptr_));
+            return DeleteNode(delete_node);
+        }
 
-            pointer node_to_destroy = nullptr;
+        // Hands the unlinked node over to a node handle instead of freeing it. The tree no longer owns it,
+        // so it is counted as deallocated here and the handle frees it uncounted
+        std::pair<iterator, node_type> DeleteNode(pointer delete_node) {
+            pointer next_node = UnlinkNode(delete_node);
+            --tree_size_;
+            statistics_.RecordDeallocation();
 
-            if (delete_node == head_root_) {
-                if (head_root_->right == nullptr || head_root_->right == end_ptr_) {
-                    pointer temp_root = head_root_->left;
-                    node_to_destroy = head_root_;
-                    head_root_ = temp_root;
-                    if (head_root_ != nullptr) {
-                        head_root_->parent = nullptr;
-                    }
+            return std::make_pair(iterator(next_node, begin_ptr_, end_ptr_), node_type(delete_node, get_allocator()));
+        }
+
+        // Unlinks and frees one node without searching for it, returns its traversal successor
+        pointer EraseNode(pointer delete_node) {
+            pointer next_node = UnlinkNode(delete_node);
+            DestroyNode(delete_node);
+
+            return next_node;
+        }
+
+        pointer UnlinkNode(pointer delete_node) {
+            // Nodes are relinked, never swapped by value, so the traversal successor stays valid
+            pointer next_node = (++iterator(delete_node, begin_ptr_, end_ptr_)).node_ptr_;
+
+            DetachEnd();
+
+            if (delete_node == min_ptr_) {
+                min_ptr_ = (delete_node->right != nullptr) ? Leftmost(delete_node->right) : delete_node->parent;
+            }
+            if (delete_node == max_ptr_) {
+                max_ptr_ = (delete_node->left != nullptr) ? Rightmost(delete_node->left) : delete_node->parent;
+            }
+
+            balancing_policy::Erase(head_root_, delete_node);
+            UpdateBeginAndEnd(tag_);
+
+            return next_node;
+        }
+
+        struct SplitResult {
+            pointer left = nullptr;
+            pointer equal = nullptr;
+            pointer right = nullptr;
+        };
+
+        // Empty tree whose nodes can be exchanged with this one
+        BinarySearchTree(const node_allocator_type& allocator, const key_compare& comparator) : allocator_(allocator), comparator_(comparator) {
+            DefaultConstructor();
+        }
+
+        static pointer Detach(pointer subtree) {
+            if (subtree != nullptr) {
+                subtree->parent = nullptr;
+            }
+
+            return subtree;
+        }
+
+        // Re-wires the sentinel and the cached pointers after head_root_ was replaced by a plain tree
+        void FinishSplice() {
+            balancing_policy::NormalizeRoot(head_root_);
+            RefreshMinAndMax();
+            UpdateBeginAndEnd(tag_);
+        }
+
+        // The helpers below work on plain trees. Split cuts along the search path for key_value and joins
+        // the pieces hanging off it bottom-up through the parent links, so the cost telescopes to O(log n)
+        template<typename K>
+        SplitResult Split(pointer root, const K& key_value) {
+            return SplitWith(root, key_value, [this](const auto& lhs, const auto& rhs) { return Compare(lhs, rhs); });
+        }
+
+        // Split with any ordering: the parallel set operations pass the bare comparator, as the statistics
+        // counters cannot be shared between tasks
+        template<typename K, typename Less>
+        static SplitResult SplitWith(pointer root, const K& key_value, Less less) {
+            SplitResult pieces;
+            pointer node = root;
+            pointer above = nullptr;
+            while (node != nullptr) {
+                above = node;
+                if (less(key_value, node->value)) {
+                    node = node->left;
+                } else if (less(node->value, key_value)) {
+                    node = node->right;
                 } else {
-                    pointer temp_root = Next(head_root_);
-                    node_to_destroy = temp_root;
-                    std::swap(temp_root->value, head_root_->value);
+                    break;
+                }
+            }
 
-                    if (temp_root->right == nullptr || temp_root->right == end_ptr_) {
-                        if (temp_root->parent->right == temp_root) {
-                            temp_root->parent->right = nullptr;
-                        } else {
-                            temp_root->parent->left = nullptr;
-                        }
-                    } else {
-                        if (temp_root->parent->left == temp_root) {
-                            temp_root->parent->left = temp_root->right;
-                        } else {
-                            temp_root->parent->right = temp_root->right;
-                        }
-                        temp_root->right->parent = temp_root->parent;
-                    }
+            if (node != nullptr) {
+                above = node->parent;
+                pieces.left = Detach(node->left);
+                pieces.right = Detach(node->right);
+                pieces.equal = node;
+                node->ResetLinks();
+            }
+
+            while (above != nullptr) {
+                pointer next_above = above->parent;
+                if (less(key_value, above->value)) {
+                    pieces.right = balancing_policy::Join(pieces.right, above, Detach(above->right));
+                } else {
+                    pieces.left = balancing_policy::Join(Detach(above->left), above, pieces.left);
                 }
+                above = next_above;
+            }
+
+            return pieces;
+        }
+
+        // Join without a pivot: the minimum of right is taken out and used as one
+        pointer JoinTrees(pointer left, pointer right) {
+            if (left == nullptr) return right;
+            if (right == nullptr) return left;
+
+            pointer pivot = Leftmost(right);
+            balancing_policy::Erase(right, pivot);
+
+            return balancing_policy::Join(left, pivot, right);
+        }
+
+        // Nodes of rhs whose key is already in lhs are chained into duplicates through their right links
+        pointer Union(pointer lhs, pointer rhs, pointer& duplicates, size_type& duplicate_count) {
+            if (lhs == nullptr) return rhs;
+            if (rhs == nullptr) return lhs;
+
+            pointer lhs_left = Detach(lhs->left);
+            pointer lhs_right = Detach(lhs->right);
+            SplitResult pieces = Split(rhs, lhs->value);
+            if (pieces.equal != nullptr) {
+                pieces.equal->right = duplicates;
+                duplicates = pieces.equal;
+                ++duplicate_count;
+            }
+
+            pointer left = Union(lhs_left, pieces.left, duplicates, duplicate_count);
+            pointer right = Union(lhs_right, pieces.right, duplicates, duplicate_count);
+
+            return balancing_policy::Join(left, lhs, right);
+        }
+
+        // The nodes of rhs belong to rhs_owner and are freed through it, so each tree's size and
+        // statistics account for its own nodes
+        pointer Intersection(pointer lhs, pointer rhs, BinarySearchTree& rhs_owner) {
+            if (lhs == nullptr || rhs == nullptr) {
+                DestroySubtree(lhs);
+                rhs_owner.DestroySubtree(rhs);
+
+                return nullptr;
+            }
+
+            pointer lhs_left = Detach(lhs->left);
+            pointer lhs_right = Detach(lhs->right);
+            SplitResult pieces = Split(rhs, lhs->value);
+            pointer left = Intersection(lhs_left, pieces.left, rhs_owner);
+            pointer right = Intersection(lhs_right, pieces.right, rhs_owner);
+
+            if (pieces.equal != nullptr) {
+                rhs_owner.DestroyNode(pieces.equal);
+
+                return balancing_policy::Join(left, lhs, right);
+            }
+            DestroyNode(lhs);
+
+            return JoinTrees(left, right);
+        }
+
+        pointer Difference(pointer lhs, pointer rhs, BinarySearchTree& rhs_owner) {
+            if (lhs == nullptr || rhs == nullptr) {
+                rhs_owner.DestroySubtree(rhs);
+
+                return lhs;
+            }
+
+            pointer rhs_left = Detach(rhs->left);
+            pointer rhs_right = Detach(rhs->right);
+            SplitResult pieces = Split(lhs, rhs->value);
+            pointer left = Difference(pieces.left, rhs_left, rhs_owner);
+            pointer right = Difference(pieces.right, rhs_right, rhs_owner);
+
+            rhs_owner.DestroyNode(rhs);
+            if (pieces.equal != nullptr) {
+                DestroyNode(pieces.equal);
+            }
+
+            return JoinTrees(left, right);
+        }
+
+        // Size of lower out of total keys split between two plain trees
+        size_type CountLowerPart(pointer lower, pointer upper, size_type total) const {
+            if constexpr (kHasOrderStatistics) {
+                return (lower == nullptr) ? 0 : lower->subtree_size;
             } else {
-                node_to_destroy = delete_node;
-                if (delete_node->left == nullptr && (delete_node->right == nullptr || delete_node->right == end_ptr_)) {
-                    if (delete_node->parent->right == delete_node) {
-                        delete_node->parent->right = nullptr;
-                    } else {
-                        delete_node->parent->left = nullptr;
-                    }
-                } else if (delete_node->left == nullptr || delete_node->right == nullptr || delete_node->right == end_ptr_) {
-                    if (delete_node->left == nullptr) {
-                        if (delete_node->parent->left == delete_node) {
-                            delete_node->parent->left = delete_node->right;
-                        } else {
-                            delete_node->parent->right = delete_node->right;
-                        }
-                        delete_node->right->parent = delete_node->parent;
-                    } else {
-                        if (delete_node->parent->left == delete_node) {
-                            delete_node->parent->left = delete_node->left;
-                        } else {
-                            delete_node->parent->right = delete_node->left;
-                        }
-                        delete_node->left->parent = delete_node->parent;
-                    }
-                } else {
-                    pointer temp_root = Next(delete_node);
-                    node_to_destroy = temp_root;
-                    std::swap(temp_root->value, delete_node->value);
-
-                    if (temp_root->parent->left == temp_root) {
-                        temp_root->parent->left = temp_root->right;
-                        if (temp_root->right != nullptr && temp_root->right != end_ptr_) {
-                            temp_root->right->parent = temp_root->parent;
-                        }
-                    } else {
-                        temp_root->parent->right = temp_root->right;
-                        if (temp_root->right != nullptr && temp_root->right != end_ptr_) {
-                            temp_root->right->parent = temp_root->parent;
-                        }
-                    }
+                pointer lower_node = (lower == nullptr) ? nullptr : Leftmost(lower);
+                pointer upper_node = (upper == nullptr) ? nullptr : Leftmost(upper);
+                size_type lower_count = 0;
+                size_type upper_count = 0;
+                while (lower_node != nullptr && upper_node != nullptr) {
+                    ++lower_count;
+                    ++upper_count;
+                    lower_node = NextInPlainTree(lower_node);
+                    upper_node = NextInPlainTree(upper_node);
                 }
+
+                return (lower_node == nullptr) ? lower_count : total - upper_count;
             }
+        }
+
+        pointer NextInPlainTree(pointer node) const {
+            if (node->right != nullptr) return Leftmost(node->right);
 
-            node_type node_to_return = node_type(node_to_destroy, allocator_);
+            while (node->parent != nullptr && node->parent->right == node) {
+                node = node->parent;
+            }
+
+            return node->parent;
+        }
+
+        // In-order predecessor regardless of the traversal tag, nullptr before the minimum
+        pointer PreviousInKeyOrder(pointer node) const {
+            if (node->left != nullptr) return Rightmost(node->left);
+
+            while (node->parent != nullptr && node->parent != end_ptr_ && node->parent->left == node) {
+                node = node->parent;
+            }
+            node = node->parent;
+
+            return node == end_ptr_ ? nullptr : node;
+        }
+
+        // In-order successor regardless of the traversal tag, nullptr after the maximum
+        pointer NextInKeyOrder(pointer node) const {
+            if (!IsEmptyChild(node->right)) return Leftmost(node->right);
+
+            while (node->parent != nullptr && node->parent != end_ptr_ && node->parent->right == node) {
+                node = node->parent;
+            }
+            node = node->parent;
+
+            return node == end_ptr_ ? nullptr : node;
+        }
+
+        // Erasing keeps the key order of the remaining nodes, so the in-order range is walked in place
+        void EraseRange(pointer first, pointer last, InOrderTraversal tag) {
+            while (first != last) {
+                first = EraseNode(first);
+            }
+        }
 
-            DestroyNode(node_to_destroy);
+        // Erasing reshapes the tree and with it the pre-order sequence, so the range is fixed up front
+        void EraseRange(pointer first, pointer last, PreOrderTraversal tag) {
+            EraseCollectedRange(first, last);
+        }
+
+        void EraseRange(pointer first, pointer last, PostOrderTraversal tag) {
+            EraseCollectedRange(first, last);
+        }
+
+        void EraseCollectedRange(pointer first, pointer last) {
+            using pointer_allocator_type = typename allocator_traits::template rebind_alloc<pointer>;
+            using pointer_allocator_traits = std::allocator_traits<pointer_allocator_type>;
+
+            size_type range_length = std::distance(iterator(first, begin_ptr_, end_ptr_), iterator(last, begin_ptr_, end_ptr_));
+            pointer_allocator_type pointer_allocator(allocator_);
+            pointer* nodes_to_delete = pointer_allocator_traits::allocate(pointer_allocator, range_length);
+
+            for (size_type i = 0; i < range_length; ++i) {
+                nodes_to_delete[i] = first;
+                first = (++iterator(first, begin_ptr_, end_ptr_)).node_ptr_;
+            }
+
+            for (size_type i = 0; i < range_length; ++i) {
+                EraseNode(nodes_to_delete[i]);
+            }
+
+            pointer_allocator_traits::deallocate(pointer_allocator, nodes_to_delete, range_length);
+        }
+
+        // Structural changes run on a plain tree (leaves end with nullptr, root has no parent),
+        // UpdateEnd wires the end_ptr_ sentinel back afterwards
+        void DetachEnd() {
+            if (end_ptr_ == nullptr) return;
+
+            if (end_ptr_->parent != nullptr && end_ptr_->parent->right == end_ptr_) {
+                end_ptr_->parent->right = nullptr;
+            }
+            end_ptr_->parent = nullptr;
+
+            if (head_root_ != nullptr) {
+                head_root_->parent = nullptr;
+            }
+        }
+
+        // With EquivalentKeys a non-decreasing range is enough, the build keeps equivalents in input order
+        template<typename ForwardIt>
+        bool IsSortedUnique(ForwardIt it1, ForwardIt it2) const {
+            return std::adjacent_find(it1, it2, [this](const auto& lhs, const auto& rhs) {
+                return kAllowsEquivalentKeys ? Compare(rhs, lhs) : !Compare(lhs, rhs);
+            }) == it2;
+        }
+
+        // Links the nodes into a perfectly balanced tree while constructing them in key order,
+        // the sentinel and the cached pointers are wired once at the end
+        template<typename ForwardIt>
+        void BuildFromSorted(ForwardIt it, size_type count) {
+            if (count == 0) return;
+
+            size_type complete_levels = std::bit_width(count + 1) - 1;
+            head_root_ = BuildBalanced(it, count, 0, complete_levels);
+            head_root_->parent = nullptr;
+
+            RefreshMinAndMax();
             UpdateBeginAndEnd(tag_);
+        }
+
+        template<typename ForwardIt>
+        pointer BuildBalanced(ForwardIt& it, size_type count, size_type depth, size_type complete_levels) {
+            if (count == 0) return nullptr;
+
+            size_type left_count = (count - 1) / 2;
+            pointer left_subtree = BuildBalanced(it, left_count, depth + 1, complete_levels);
+
+            // Each level frees the part it built before passing a throw on, so a failed build leaves no nodes
+            pointer new_node = nullptr;
+            try {
+                new_node = ConstructNewNode(*it);
+            } catch (...) {
+                DestroySubtree(left_subtree);
+                throw;
+            }
+            ++it;
+
+            new_node->left = left_subtree;
+            if (left_subtree != nullptr) {
+                left_subtree->parent = new_node;
+            }
 
-            iterator next_to_delete_node_iter = iterator(Search(next_traversal_node_value), tag_, begin_ptr_, end_ptr_);
+            try {
+                new_node->right = BuildBalanced(it, count - 1 - left_count, depth + 1, complete_levels);
+            } catch (...) {
+                DestroySubtree(new_node);
+                throw;
+            }
+            if (new_node->right != nullptr) {
+                new_node->right->parent = new_node;
+            }
+
+            balancing_policy::MarkBalancedNode(new_node, depth, complete_levels);
+            new_node->RefreshData();
 
-            return std::make_pair(next_to_delete_node_iter, node_to_return);
+            return new_node;
+        }
+
+        template<typename K>
+        pointer ConstructNewNode(K&& key_value) {
+            return ConstructNodeInPlace(std::forward<K>(key_value));
         }
 
-        pointer ConstructNewNode(key_type key_value) {
+        // Constructs the value from args inside the node, nothing is copied or moved afterwards. The node
+        // is only counted once its value is built
+        template<typename... Args>
+        pointer ConstructNodeInPlace(Args&&... args) {
+            EnsureEnd();
+            pointer new_node = AllocateNode(std::forward<Args>(args)...);
             ++tree_size_;
+            statistics_.RecordAllocations(1);
+
+            return new_node;
+        }
+
+        // The node is only built when no key equivalent to key_value is present, which the caller
+        // guarantees args would produce
+        template<typename K, typename... Args>
+        std::pair<pointer, bool> TryEmplace(const K& key_value, Args&&... args) {
+            InsertPosition position = FindInsertPosition(key_value);
+            if (position.duplicate != nullptr) return {position.duplicate, false};
+
+            pointer new_node = ConstructNodeInPlace(std::forward<Args>(args)...);
+            AttachNode(new_node, position);
+
+            return {new_node, true};
+        }
+
+        // Leaves tree_size_ alone, so parallel builders can allocate from several threads and count once.
+        // The storage is given back when the value's constructor throws
+        template<typename... Args>
+        pointer AllocateNode(Args&&... args) {
             pointer new_node = allocator_traits::allocate(allocator_, 1);
-            allocator_traits::construct(allocator_, new_node, key_value);
+            try {
+                allocator_traits::construct(allocator_, new_node, std::in_place, std::forward<Args>(args)...);
+            } catch (...) {
+                allocator_traits::deallocate(allocator_, new_node, 1);
+                throw;
+            }
 
             return new_node;
         }
 
         void DestroyNode(pointer& current_node) {
             --tree_size_;
+            statistics_.RecordDeallocation();
+            DeallocateNode(current_node);
+        }
+
+        // Counterpart of AllocateNode for nodes that were never counted in
+        void DeallocateNode(pointer& current_node) {
             allocator_traits::destroy(allocator_, current_node);
             allocator_traits::deallocate(allocator_, current_node, 1);
             current_node = nullptr;
         }
 
-        pointer CopyTree(pointer root) {
-            if (root == nullptr) return nullptr;
-
-            pointer new_node = ConstructNewNode(root->value);
-            if (root == end_ptr_) {
-                end_ptr_ = new_node;
-                --tree_size_;
+        // Walks both trees in lockstep over parent links: a missing copy of an existing child means the walk
+        // comes down, otherwise it goes back up. Nodes are allocated in pre-order, so the copy is laid out
+        // in traversal order and the walk needs no stack
+        pointer CopyTree(pointer other_root, pointer other_end) {
+            if (other_root == nullptr || other_root == other_end) return nullptr;
+
+            pointer copy_root = ConstructNewNode(other_root->value);
+            copy_root->CopyData(*other_root);
+
+            // Every copied node is linked in right away, so a throw can free the partial copy from its root
+            pointer other_node = other_root;
+            pointer copy_node = copy_root;
+            try {
+                while (true) {
+                    if (other_node->left != nullptr && copy_node->left == nullptr) {
+                        copy_node->left = ConstructNewNode(other_node->left->value);
+                        copy_node->left->CopyData(*other_node->left);
+                        copy_node->left->parent = copy_node;
+                        other_node = other_node->left;
+                        copy_node = copy_node->left;
+                    } else if (other_node->right != nullptr && other_node->right != other_end && copy_node->right == nullptr) {
+                        copy_node->right = ConstructNewNode(other_node->right->value);
+                        copy_node->right->CopyData(*other_node->right);
+                        copy_node->right->parent = copy_node;
+                        other_node = other_node->right;
+                        copy_node = copy_node->right;
+                    } else if (other_node == other_root) {
+                        break;
+                    } else {
+                        other_node = other_node->parent;
+                        copy_node = copy_node->parent;
+                    }
+                }
+            } catch (...) {
+                DestroySubtree(copy_root);
+                throw;
             }
 
-            if (root->parent == end_ptr_) {
-                end_ptr_ = ConstructNewNode(key_type{});
-                --tree_size_;
-                new_node->parent = end_ptr_;
-            }
+            return copy_root;
+        }
 
-            new_node->left = CopyTree(root->left);
-            new_node->right = CopyTree(root->right);
-            if (new_node->left != nullptr) {
-                new_node->left->parent = new_node;
-            }
-            if (new_node->right != nullptr) {
-                new_node->right->parent = new_node;
-            }
+        void Clear() {
+            DetachEnd();
+            DestroySubtree(head_root_);
 
-            return new_node;
+            head_root_ = nullptr;
+            min_ptr_ = nullptr;
+            max_ptr_ = nullptr;
+            UpdateBeginAndEnd(tag_);
+        }
+
+        void DestroySubtree(pointer subtree) {
+            FreeSubtree(subtree, [this](pointer& node) { DestroyNode(node); });
         }
 
-        void Clear(pointer root) {
-            if (root != nullptr && root != end_ptr_) {
-                Clear(root->left);
-                Clear(root->right);
-                DestroyNode(root);
+        void DeallocateSubtree(pointer subtree) {
+            FreeSubtree(subtree, [this](pointer& node) { DeallocateNode(node); });
+        }
+
+        // Post-order sweep over parent links: a node is freed once both children are gone,
+        // so no stack or buffer grows with the tree
+        template<typename Free>
+        void FreeSubtree(pointer subtree, Free free) {
+            pointer temp_node = subtree;
+            while (temp_node != nullptr) {
+                if (temp_node->left != nullptr) {
+                    temp_node = temp_node->left;
+                } else if (temp_node->right != nullptr) {
+                    temp_node = temp_node->right;
+                } else {
+                    pointer parent = temp_node->parent;
+                    if (parent != nullptr) {
+                        if (parent->left == temp_node) {
+                            parent->left = nullptr;
+                        } else {
+                            parent->right = nullptr;
+                        }
+                    }
+                    free(temp_node);
+                    temp_node = parent;
+                }
             }
         }
 
-        pointer Search(key_type key_value) const {
+        size_type SubtreeSize(pointer node) const {
+            return IsEmptyChild(node) ? 0 : node->subtree_size;
+        }
+
+        template<typename K>
+        size_type Rank(const K& key_value) const {
+            size_type smaller_keys = 0;
             pointer temp_root = head_root_;
-            while (temp_root != nullptr && temp_root != end_ptr_) {
-                if (temp_root->value == key_value) {
-                    break;
+            while (!IsEmptyChild(temp_root)) {
+                if (Compare(temp_root->value, key_value)) {
+                    smaller_keys += SubtreeSize(temp_root->left) + 1;
+                    temp_root = temp_root->right;
+                } else {
+                    temp_root = temp_root->left;
                 }
-                if (comparator_(key_value, temp_root->value)) {
+            }
+
+            return smaller_keys;
+        }
+
+        template<typename K>
+        size_type CountRange(const K& lower_key, const K& upper_key) const {
+            if (!Compare(lower_key, upper_key)) return 0;
+
+            return Rank(upper_key) - Rank(lower_key);
+        }
+
+        pointer SelectInOrder(size_type index) const {
+            pointer temp_root = head_root_;
+            while (true) {
+                size_type left_size = SubtreeSize(temp_root->left);
+                if (index < left_size) {
                     temp_root = temp_root->left;
+                } else if (index == left_size) {
+                    return temp_root;
                 } else {
+                    index -= left_size + 1;
                     temp_root = temp_root->right;
                 }
             }
+        }
 
-            return (temp_root == nullptr) ? end_ptr_ : temp_root;
+        bool IsRootOrSentinel(pointer node) const {
+            return node->parent == nullptr || node->parent == end_ptr_;
         }
 
-        pointer Minimum(pointer root) {
-            if (root->left == nullptr) return root;
+        // Position of node in the traversal order, counted by walking up and adding the subtrees the
+        // traversal visits before it; end() is at size()
+        size_type IndexOf(pointer node, PreOrderTraversal tag) const {
+            if (node == end_ptr_) return tree_size_;
 
-            return Minimum(root->left);
+            size_type index = 0;
+            for (; !IsRootOrSentinel(node); node = node->parent) {
+                index += (node->parent->left == node) ? 1 : SubtreeSize(node->parent->left) + 1;
+            }
+
+            return index;
         }
 
-        pointer Maximum(pointer root) {
-            if (root->right == nullptr || root->right == end_ptr_) return root;
+        size_type IndexOf(pointer node, InOrderTraversal tag) const {
+            if (node == end_ptr_) return tree_size_;
 
-            return Maximum(root->right);
-        }
+            size_type index = SubtreeSize(node->left);
+            for (; !IsRootOrSentinel(node); node = node->parent) {
+                if (node->parent->right == node) {
+                    index += SubtreeSize(node->parent->left) + 1;
+                }
+            }
 
-        pointer Next(pointer root) {
-            if (root == head_root_ && (root->right == nullptr || root->right == end_ptr_)) return nullptr;
+            return index;
+        }
 
-            if (root->right != nullptr && root->right != end_ptr_) return Minimum(root->right);
+        size_type IndexOf(pointer node, PostOrderTraversal tag) const {
+            if (node == end_ptr_) return tree_size_;
 
-            pointer node_parent = root->parent;
-            while ((node_parent != nullptr && node_parent != end_ptr_) && root == node_parent->right) {
-                root = node_parent;
-                node_parent = node_parent->parent;
+            size_type index = SubtreeSize(node->left) + SubtreeSize(node->right);
+            for (; !IsRootOrSentinel(node); node = node->parent) {
+                if (node->parent->right == node) {
+                    index += SubtreeSize(node->parent->left);
+                }
             }
 
-            return node_parent;
+            return index;
         }
 
-        pointer LowerBound(key_type key_value) const {
+        pointer NodeAt(size_type index, PreOrderTraversal tag) const {
             pointer temp_root = head_root_;
-            pointer successor = end_ptr_;
-            while (temp_root != nullptr && temp_root != end_ptr_) {
-                if (!comparator_(temp_root->value, key_value)) {
-                    successor = temp_root;
+            while (index != 0) {
+                --index;
+                size_type left_size = SubtreeSize(temp_root->left);
+                if (index < left_size) {
                     temp_root = temp_root->left;
                 } else {
+                    index -= left_size;
                     temp_root = temp_root->right;
                 }
             }
 
-            return successor;
+            return temp_root;
+        }
+
+        pointer NodeAt(size_type index, InOrderTraversal tag) const {
+            return SelectInOrder(index);
         }
 
-        pointer UpperBound(key_type key_value) const {
+        pointer NodeAt(size_type index, PostOrderTraversal tag) const {
+            pointer temp_root = head_root_;
+            while (true) {
+                size_type left_size = SubtreeSize(temp_root->left);
+                size_type right_size = SubtreeSize(temp_root->right);
+                if (index < left_size) {
+                    temp_root = temp_root->left;
+                } else if (index < left_size + right_size) {
+                    index -= left_size;
+                    temp_root = temp_root->right;
+                } else {
+                    return temp_root;
+                }
+            }
+        }
+
+        // Equivalence comes from the comparator alone: descend like LowerBound with one comparison per level,
+        // then check the single candidate once
+        template<typename K>
+        pointer Search(const K& key_value, TreeOperation operation = TreeOperation::kSearch) const {
+            pointer candidate = LowerBound(key_value, operation);
+
+            if (candidate != end_ptr_ && Compare(key_value, candidate->value)) return end_ptr_;
+
+            return candidate;
+        }
+
+        template<typename K>
+        pointer LowerBound(const K& key_value, TreeOperation operation = TreeOperation::kSearch) const {
             pointer temp_root = head_root_;
             pointer successor = end_ptr_;
+            size_type depth = 0;
             while (temp_root != nullptr && temp_root != end_ptr_) {
-                if (comparator_(key_value, temp_root->value)) {
+                ++depth;
+                if (!Compare(temp_root->value, key_value)) {
                     successor = temp_root;
                     temp_root = temp_root->left;
                 } else {
                     temp_root = temp_root->right;
                 }
             }
+            statistics_.RecordPath(operation, depth);
 
             return successor;
         }
 
-        pointer Previous(pointer root) {
-            if (root == head_root_ && root->left == nullptr) return nullptr;
+        // An exact batch reports end() for absent keys but keeps following the lower bounds
+        template<typename KeyIt, typename OutputIt>
+        OutputIt LowerBoundBatch(KeyIt first, KeyIt last, OutputIt results, bool exact) const {
+            pointer finger = nullptr;
+            for (KeyIt previous = first; first != last; previous = first, ++first) {
+                if (finger != nullptr && Compare(*first, *previous)) {
+                    finger = nullptr;
+                }
+                finger = (finger == nullptr) ? LowerBound(*first) : FingerLowerBound(finger, *first);
+
+                pointer result = (exact && finger != end_ptr_ && Compare(*first, finger->value)) ? end_ptr_ : finger;
+                *results = iterator(result, begin_ptr_, end_ptr_);
+                ++results;
+            }
+
+            return results;
+        }
+
+        // Lower bound of key_value, given finger as the lower bound of some key not greater than it. Every
+        // node the walk leaves behind is less than key_value: the finger and the nodes above it reached from
+        // the right are below the finger, those reached from the left were compared. The first ancestor
+        // reached from the left that is not less bounds the answer, and the search ends in the subtree below it
+        template<typename K>
+        pointer FingerLowerBound(pointer finger, const K& key_value) const {
+            if (finger == end_ptr_) {
+                statistics_.RecordPath(TreeOperation::kSearch, 0);
+                return end_ptr_;
+            }
+            size_type depth = 1;
+            if (!Compare(finger->value, key_value)) {
+                statistics_.RecordPath(TreeOperation::kSearch, depth);
+                return finger;
+            }
+
+            pointer subtree = finger;
+            pointer successor = end_ptr_;
+            for (pointer parent = subtree->parent; parent != nullptr && parent != end_ptr_; parent = subtree->parent) {
+                ++depth;
+                if (parent->left == subtree && !Compare(parent->value, key_value)) {
+                    successor = parent;
+                    break;
+                }
+                subtree = parent;
+            }
+
+            for (pointer node = subtree->right; !IsEmptyChild(node); ) {
+                ++depth;
+                if (!Compare(node->value, key_value)) {
+                    successor = node;
+                    node = node->left;
+                } else {
+                    node = node->right;
+                }
+            }
+            statistics_.RecordPath(TreeOperation::kSearch, depth);
 
-            if (root->left != nullptr) return Maximum(root->left);
+            return successor;
+        }
 
-            pointer node_parent = root->parent;
-            while ((node_parent != nullptr && node_parent != end_ptr_) && root == node_parent->left) {
-                root = node_parent;
-                node_parent = node_parent->parent;
+        template<typename K>
+        pointer UpperBound(const K& key_value, TreeOperation operation = TreeOperation::kSearch) const {
+            pointer temp_root = head_root_;
+            pointer successor = end_ptr_;
+            size_type depth = 0;
+            while (temp_root != nullptr && temp_root != end_ptr_) {
+                ++depth;
+                if (Compare(key_value, temp_root->value)) {
+                    successor = temp_root;
+                    temp_root = temp_root->left;
+                } else {
+                    temp_root = temp_root->right;
+                }
             }
+            statistics_.RecordPath(operation, depth);
 
-            return node_parent;
+            return successor;
         }
     };
 }
\ No newline at end of file
@@ -0,0 +1,865 @@
+#pragma once
+#include "bst.h"
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector> // FOR TRAVERSAL TESTING
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace BST {
+    namespace detail {
+        // Arithmetic keys under plain operator< are searched by counting the keys below the probe across
+        // the whole node: no branches and no dependency on the node's fill, unused slots hold SentinelKey
+        template<typename Key, typename Comparator>
+        concept CountingSearchKey = std::is_arithmetic_v<Key> && !std::is_same_v<Key, bool>
+                && (std::is_same_v<Comparator, std::less<Key>> || std::is_same_v<Comparator, std::less<>>);
+
+        template<typename Key>
+        constexpr Key SentinelKey() {
+            if constexpr (std::numeric_limits<Key>::has_infinity) {
+                return std::numeric_limits<Key>::infinity();
+            } else {
+                return std::numeric_limits<Key>::max();
+            }
+        }
+
+        // Number of keys[i] < key over all Capacity slots. The widest compare-and-movemask kernel the
+        // target supports is picked at compile time: 64-bit integers need AVX2 or SSE4.2 (the first
+        // 64-bit compare), the rest SSE2 or AVX. Other types use the scalar loop
+        template<typename Key, std::size_t Capacity>
+        std::size_t CountLess(const Key* keys, Key key) {
+            [[maybe_unused]] constexpr bool kSigned32 = std::is_integral_v<Key> && std::is_signed_v<Key> && sizeof(Key) == 4;
+            [[maybe_unused]] constexpr bool kSigned64 = std::is_integral_v<Key> && std::is_signed_v<Key> && sizeof(Key) == 8;
+            std::size_t count = 0;
+
+#if defined(__AVX2__)
+            if constexpr (kSigned32) {
+                __m256i probe = _mm256_set1_epi32(static_cast<std::int32_t>(key));
+                for (std::size_t i = 0; i < Capacity; i += 8) {
+                    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+                    __m256i less = _mm256_cmpgt_epi32(probe, block);
+                    count += std::popcount(static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(less))));
+                }
+
+                return count;
+            }
+            if constexpr (kSigned64) {
+                __m256i probe = _mm256_set1_epi64x(static_cast<std::int64_t>(key));
+                for (std::size_t i = 0; i < Capacity; i += 4) {
+                    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+                    __m256i less = _mm256_cmpgt_epi64(probe, block);
+                    count += std::popcount(static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(less))));
+                }
+
+                return count;
+            }
+#endif
+#if defined(__AVX__)
+            if constexpr (std::is_same_v<Key, double>) {
+                __m256d probe = _mm256_set1_pd(key);
+                for (std::size_t i = 0; i < Capacity; i += 4) {
+                    __m256d less = _mm256_cmp_pd(_mm256_loadu_pd(keys + i), probe, _CMP_LT_OQ);
+                    count += std::popcount(static_cast<unsigned>(_mm256_movemask_pd(less)));
+                }
+
+                return count;
+            }
+            if constexpr (std::is_same_v<Key, float>) {
+                __m256 probe = _mm256_set1_ps(key);
+                for (std::size_t i = 0; i < Capacity; i += 8) {
+                    __m256 less = _mm256_cmp_ps(_mm256_loadu_ps(keys + i), probe, _CMP_LT_OQ);
+                    count += std::popcount(static_cast<unsigned>(_mm256_movemask_ps(less)));
+                }
+
+                return count;
+            }
+#endif
+#if defined(__SSE4_2__)
+            if constexpr (kSigned64) {
+                __m128i probe = _mm_set1_epi64x(static_cast<std::int64_t>(key));
+                for (std::size_t i = 0; i < Capacity; i += 2) {
+                    __m128i less = _mm_cmpgt_epi64(probe, _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)));
+                    count += std::popcount(static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(less))));
+                }
+
+                return count;
+            }
+#endif
+#if defined(__SSE2__)
+            if constexpr (kSigned32) {
+                __m128i probe = _mm_set1_epi32(static_cast<std::int32_t>(key));
+                for (std::size_t i = 0; i < Capacity; i += 4) {
+                    __m128i less = _mm_cmplt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), probe);
+                    count += std::popcount(static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(less))));
+                }
+
+                return count;
+            }
+            if constexpr (std::is_same_v<Key, double>) {
+                __m128d probe = _mm_set1_pd(key);
+                for (std::size_t i = 0; i < Capacity; i += 2) {
+                    count += std::popcount(static_cast<unsigned>(_mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(keys + i), probe))));
+                }
+
+                return count;
+            }
+            if constexpr (std::is_same_v<Key, float>) {
+                __m128 probe = _mm_set1_ps(key);
+                for (std::size_t i = 0; i < Capacity; i += 4) {
+                    count += std::popcount(static_cast<unsigned>(_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(keys + i), probe))));
+                }
+
+                return count;
+            }
+#endif
+            for (std::size_t i = 0; i < Capacity; ++i) {
+                count += static_cast<std::size_t>(keys[i] < key);
+            }
+
+            return count;
+        }
+    }
+
+    // Wide-node (B+-tree) ordered set with the lookup API of BinarySearchTree. Nodes hold 16..64 keys
+    // (about 256 bytes of keys), all keys live in leaves chained for in-order iteration, inner nodes only
+    // route. Keys have to be default constructible and copyable, the node arrays are plain Key arrays
+    template<std::semiregular Key, typename Comparator = std::less<Key>, typename Allocator = std::allocator<Key>>
+    class BPlusTree {
+        static constexpr std::size_t kCapacity = std::clamp<std::size_t>(256 / sizeof(Key), 16, 64) / 8 * 8;
+        static constexpr std::size_t kMinKeys = kCapacity / 2;
+        static constexpr std::size_t kMaxHeight = 32;
+        static constexpr bool kCountingSearch = detail::CountingSearchKey<Key, Comparator>;
+
+        struct NodeBase {
+            Key keys[kCapacity];
+            std::size_t count = 0;
+
+            NodeBase() {
+                if constexpr (kCountingSearch) {
+                    std::fill_n(keys, kCapacity, detail::SentinelKey<Key>());
+                }
+            }
+        };
+
+        struct LeafNode : NodeBase {
+            LeafNode* next = nullptr;
+            LeafNode* previous = nullptr;
+        };
+
+        // children[i] holds the keys below keys[i], children[i + 1] the keys from keys[i] on
+        struct InnerNode : NodeBase {
+            NodeBase* children[kCapacity + 1] = {};
+        };
+
+        struct PathEntry {
+            InnerNode* node;
+            std::size_t index;
+        };
+    public:
+        class Iterator {
+        public:
+            using value_type = Key;
+            using pointer = const value_type*;
+            using reference = const value_type&;
+            using difference_type = std::ptrdiff_t;
+            using iterator_category = std::bidirectional_iterator_tag;
+
+            Iterator() = default;
+
+            explicit Iterator(const BPlusTree* tree, LeafNode* leaf, std::size_t index) : tree_(tree), leaf_(leaf), index_(index) {};
+
+            bool operator==(const Iterator& rhs_iter) const {
+                return leaf_ == rhs_iter.leaf_ && index_ == rhs_iter.index_;
+            }
+
+            bool operator!=(const Iterator& rhs_iter) const {
+                return !(operator==(rhs_iter));
+            }
+
+            Iterator& operator++() {
+                if (++index_ == leaf_->count) {
+                    leaf_ = leaf_->next;
+                    index_ = 0;
+                }
+
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                auto temp_iter = *this;
+                ++*this;
+
+                return temp_iter;
+            }
+
+            Iterator& operator--() {
+                if (leaf_ == nullptr) {
+                    leaf_ = tree_->last_leaf_;
+                    index_ = leaf_->count - 1;
+                } else if (index_ == 0) {
+                    leaf_ = leaf_->previous;
+                    index_ = leaf_->count - 1;
+                } else {
+                    --index_;
+                }
+
+                return *this;
+            }
+
+            Iterator operator--(int) {
+                auto temp_iter = *this;
+                --*this;
+
+                return temp_iter;
+            }
+
+            reference operator*() const {
+                return leaf_->keys[index_];
+            }
+
+            pointer operator->() const {
+                return leaf_->keys + index_;
+            }
+        private:
+            const BPlusTree* tree_ = nullptr;
+            LeafNode* leaf_ = nullptr;
+            std::size_t index_ = 0;
+        };
+
+        using key_type = Key;
+        using value_type = Key;
+        using key_compare = Comparator;
+        using value_compare = Comparator;
+        using allocator_type = Allocator;
+        using size_type = std::size_t;
+        using difference_type = std::ptrdiff_t;
+        using reference = const value_type&;
+        using const_reference = const value_type&;
+        using iterator = Iterator;
+        using const_iterator = Iterator;
+        using reverse_iterator = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+        BPlusTree() = default;
+
+        BPlusTree(const std::initializer_list<key_type>& values_list) {
+            insert(values_list);
+        }
+
+        template<LegacyInputIterator InputIt>
+        BPlusTree(InputIt it1, InputIt it2) {
+            insert(it1, it2);
+        }
+
+        BPlusTree(const BPlusTree& other) : comparator_(other.comparator_), allocator_(other.allocator_) {
+            if (other.root_ == nullptr) return;
+
+            root_ = CloneSubtree(other.root_, other.height_);
+            height_ = other.height_;
+            size_ = other.size_;
+        }
+
+        BPlusTree(BPlusTree&& other) noexcept {
+            swap(other);
+        }
+
+        ~BPlusTree() {
+            clear();
+        }
+
+        BPlusTree& operator=(BPlusTree rhs) noexcept {
+            swap(rhs);
+
+            return *this;
+        }
+
+        bool operator==(const BPlusTree& rhs) const {
+            return size_ == rhs.size_ && std::equal(begin(), end(), rhs.begin(), rhs.end());
+        }
+
+        bool operator!=(const BPlusTree& rhs) const {
+            return !(operator==(rhs));
+        }
+
+        [[nodiscard]] std::vector<key_type> TraversalToVector() const {
+            return std::vector<key_type>(begin(), end());
+        }
+
+        iterator begin() const {
+            return iterator(this, first_leaf_, 0);
+        }
+
+        iterator end() const {
+            return iterator(this, nullptr, 0);
+        }
+
+        const_iterator cbegin() const {
+            return begin();
+        }
+
+        const_iterator cend() const {
+            return end();
+        }
+
+        reverse_iterator rbegin() const {
+            return reverse_iterator(end());
+        }
+
+        reverse_iterator rend() const {
+            return reverse_iterator(begin());
+        }
+
+        [[nodiscard]] size_type size() const {
+            return size_;
+        }
+
+        [[nodiscard]] bool empty() const {
+            return size_ == 0;
+        }
+
+        [[nodiscard]] size_type max_size() const {
+            return std::numeric_limits<size_type>::max();
+        }
+
+        [[nodiscard]] key_compare key_comp() const {
+            return comparator_;
+        }
+
+        [[nodiscard]] value_compare value_comp() const {
+            return comparator_;
+        }
+
+        [[nodiscard]] allocator_type get_allocator() const {
+            return allocator_;
+        }
+
+        template <typename... Args>
+        std::pair<iterator, bool> emplace(Args&&... args) {
+            return insert(key_type(std::forward<Args>(args)...));
+        }
+
+        std::pair<iterator, bool> insert(const key_type& key_value) {
+            return Insert(key_value);
+        }
+
+        template<LegacyInputIterator InputIt>
+        void insert(InputIt it1, InputIt it2) {
+            for (auto it = it1; it != it2; ++it) {
+                insert(*it);
+            }
+        }
+
+        void insert(const std::initializer_list<key_type>& values_list) {
+            insert(values_list.begin(), values_list.end());
+        }
+
+        size_type erase(const key_type& key_value) {
+            return Erase(key_value);
+        }
+
+        iterator erase(const_iterator node_iter) {
+            if (node_iter == cend()) throw std::runtime_error("Attempt to extract end of container");
+
+            key_type key_value = *node_iter;
+            Erase(key_value);
+
+            return lower_bound(key_value);
+        }
+
+        iterator find(const key_type& key_value) const {
+            if (root_ == nullptr) return end();
+
+            LeafNode* leaf = FindLeaf(key_value);
+            size_type index = LowerIndex(leaf, key_value);
+            if (index == leaf->count || comparator_(key_value, leaf->keys[index])) return end();
+
+            return iterator(this, leaf, index);
+        }
+
+        size_type count(const key_type& key_value) const {
+            return find(key_value) != end();
+        }
+
+        bool contains(const key_type& key_value) const {
+            return count(key_value);
+        }
+
+        iterator lower_bound(const key_type& key_value) const {
+            if (root_ == nullptr) return end();
+
+            LeafNode* leaf = FindLeaf(key_value);
+
+            return LeafPosition(leaf, LowerIndex(leaf, key_value));
+        }
+
+        iterator upper_bound(const key_type& key_value) const {
+            if (root_ == nullptr) return end();
+
+            LeafNode* leaf = FindLeaf(key_value);
+
+            return LeafPosition(leaf, UpperIndex(leaf, key_value));
+        }
+
+        void clear() {
+            if (root_ != nullptr) {
+                DestroySubtree(root_, height_);
+            }
+
+            root_ = nullptr;
+            first_leaf_ = nullptr;
+            last_leaf_ = nullptr;
+            height_ = 0;
+            size_ = 0;
+        }
+
+        void swap(BPlusTree& rhs) noexcept {
+            std::swap(root_, rhs.root_);
+            std::swap(first_leaf_, rhs.first_leaf_);
+            std::swap(last_leaf_, rhs.last_leaf_);
+            std::swap(height_, rhs.height_);
+            std::swap(size_, rhs.size_);
+            std::swap(comparator_, rhs.comparator_);
+            std::swap(allocator_, rhs.allocator_);
+        }
+
+        friend void swap(BPlusTree& lhs, BPlusTree& rhs) noexcept {
+            lhs.swap(rhs);
+        }
+    private:
+        using leaf_allocator_type = typename std::allocator_traits<allocator_type>::template rebind_alloc<LeafNode>;
+        using leaf_allocator_traits = std::allocator_traits<leaf_allocator_type>;
+        using inner_allocator_type = typename std::allocator_traits<allocator_type>::template rebind_alloc<InnerNode>;
+        using inner_allocator_traits = std::allocator_traits<inner_allocator_type>;
+
+        NodeBase* root_ = nullptr;
+        LeafNode* first_leaf_ = nullptr;
+        LeafNode* last_leaf_ = nullptr;
+        size_type height_ = 0; // inner levels above the leaves
+        size_type size_ = 0;
+        key_compare comparator_;
+        allocator_type allocator_;
+
+        size_type LowerIndex(const NodeBase* node, const key_type& key_value) const {
+            if constexpr (kCountingSearch) {
+                return detail::CountLess<Key, kCapacity>(node->keys, key_value);
+            } else {
+                return std::lower_bound(node->keys, node->keys + node->count, key_value, comparator_) - node->keys;
+            }
+        }
+
+        // Keys are unique, so at most one slot is equivalent to the probe
+        size_type UpperIndex(const NodeBase* node, const key_type& key_value) const {
+            size_type index = LowerIndex(node, key_value);
+            if (index < node->count && !comparator_(key_value, node->keys[index])) {
+                ++index;
+            }
+
+            return index;
+        }
+
+        LeafNode* FindLeaf(const key_type& key_value) const {
+            NodeBase* node = root_;
+            for (size_type level = 0; level < height_; ++level) {
+                auto* inner = static_cast<InnerNode*>(node);
+                node = inner->children[UpperIndex(inner, key_value)];
+            }
+
+            return static_cast<LeafNode*>(node);
+        }
+
+        // Keys past a leaf's end continue at the next leaf's first slot
+        iterator LeafPosition(LeafNode* leaf, size_type index) const {
+            if (index == leaf->count) return iterator(this, leaf->next, 0);
+
+            return iterator(this, leaf, index);
+        }
+
+        std::pair<iterator, bool> Insert(const key_type& key_value) {
+            if (root_ == nullptr) {
+                LeafNode* leaf = ConstructLeaf();
+                root_ = leaf;
+                first_leaf_ = leaf;
+                last_leaf_ = leaf;
+            }
+
+            PathEntry path[kMaxHeight];
+            NodeBase* node = root_;
+            for (size_type level = 0; level < height_; ++level) {
+                auto* inner = static_cast<InnerNode*>(node);
+                path[level] = PathEntry{inner, UpperIndex(inner, key_value)};
+                node = inner->children[path[level].index];
+            }
+
+            auto* leaf = static_cast<LeafNode*>(node);
+            size_type index = LowerIndex(leaf, key_value);
+            if (index < leaf->count && !comparator_(key_value, leaf->keys[index])) {
+                return std::make_pair(iterator(this, leaf, index), false);
+            }
+
+            ++size_;
+            if (leaf->count < kCapacity) {
+                InsertKey(leaf, index, key_value);
+
+                return std::make_pair(iterator(this, leaf, index), true);
+            }
+
+            LeafNode* right_leaf = SplitLeaf(leaf);
+            iterator position;
+            if (index <= leaf->count) {
+                InsertKey(leaf, index, key_value);
+                position = iterator(this, leaf, index);
+            } else {
+                InsertKey(right_leaf, index - leaf->count, key_value);
+                position = iterator(this, right_leaf, index - leaf->count);
+            }
+
+            InsertIntoParents(path, right_leaf->keys[0], right_leaf);
+
+            return std::make_pair(position, true);
+        }
+
+        // Moves the upper half of a full leaf into a new right neighbour
+        LeafNode* SplitLeaf(LeafNode* leaf) {
+            LeafNode* right_leaf = ConstructLeaf();
+            MoveTail(leaf, right_leaf, kMinKeys);
+
+            right_leaf->next = leaf->next;
+            right_leaf->previous = leaf;
+            if (leaf->next == nullptr) {
+                last_leaf_ = right_leaf;
+            } else {
+                leaf->next->previous = right_leaf;
+            }
+            leaf->next = right_leaf;
+
+            return right_leaf;
+        }
+
+        // Walks the recorded path bottom-up adding (separator, right_node) next to the split child,
+        // full inner nodes split in turn and a split root grows the tree by one level
+        void InsertIntoParents(PathEntry* path, key_type separator, NodeBase* right_node) {
+            for (size_type level = height_; level-- > 0;) {
+                InnerNode* inner = path[level].node;
+                size_type index = path[level].index;
+
+                if (inner->count < kCapacity) {
+                    InsertRoute(inner, index, separator, right_node);
+                    return;
+                }
+
+                key_type keys[kCapacity + 1];
+                NodeBase* children[kCapacity + 2];
+                std::copy_n(inner->keys, index, keys);
+                keys[index] = separator;
+                std::copy(inner->keys + index, inner->keys + kCapacity, keys + index + 1);
+                std::copy_n(inner->children, index + 1, children);
+                children[index + 1] = right_node;
+                std::copy(inner->children + index + 1, inner->children + kCapacity + 1, children + index + 2);
+
+                InnerNode* right_inner = ConstructInner();
+                AssignRoutes(inner, keys, children, kMinKeys);
+                AssignRoutes(right_inner, keys + kMinKeys + 1, children + kMinKeys + 1, kCapacity - kMinKeys);
+
+                separator = keys[kMinKeys];
+                right_node = right_inner;
+            }
+
+            InnerNode* new_root = ConstructInner();
+            new_root->keys[0] = separator;
+            new_root->children[0] = root_;
+            new_root->children[1] = right_node;
+            new_root->count = 1;
+            root_ = new_root;
+            ++height_;
+        }
+
+        size_type Erase(const key_type& key_value) {
+            if (root_ == nullptr) return 0;
+
+            PathEntry path[kMaxHeight];
+            NodeBase* node = root_;
+            for (size_type level = 0; level < height_; ++level) {
+                auto* inner = static_cast<InnerNode*>(node);
+                path[level] = PathEntry{inner, UpperIndex(inner, key_value)};
+                node = inner->children[path[level].index];
+            }
+
+            auto* leaf = static_cast<LeafNode*>(node);
+            size_type index = LowerIndex(leaf, key_value);
+            if (index == leaf->count || comparator_(key_value, leaf->keys[index])) return 0;
+
+            RemoveKey(leaf, index);
+            --size_;
+
+            // Separators may now be smaller than their subtree's minimum, they still route correctly
+            for (size_type level = height_; level-- > 0 && node->count < kMinKeys;) {
+                FixUnderflow(path[level].node, path[level].index, level + 1 == height_);
+                node = path[level].node;
+            }
+
+            ShrinkRoot();
+
+            return 1;
+        }
+
+        // Refills children[index] from a sibling that can spare a key, otherwise merges it with one
+        void FixUnderflow(InnerNode* parent, size_type index, bool children_are_leaves) {
+            NodeBase* left = (index > 0) ? parent->children[index - 1] : nullptr;
+            NodeBase* right = (index < parent->count) ? parent->children[index + 1] : nullptr;
+
+            if (right != nullptr && right->count > kMinKeys) {
+                if (children_are_leaves) {
+                    BorrowFromRightLeaf(parent, index);
+                } else {
+                    BorrowFromRightInner(parent, index);
+                }
+            } else if (left != nullptr && left->count > kMinKeys) {
+                if (children_are_leaves) {
+                    BorrowFromLeftLeaf(parent, index);
+                } else {
+                    BorrowFromLeftInner(parent, index);
+                }
+            } else {
+                size_type left_index = (right != nullptr) ? index : index - 1;
+                if (children_are_leaves) {
+                    MergeLeaves(parent, left_index);
+                } else {
+                    MergeInner(parent, left_index);
+                }
+            }
+        }
+
+        void BorrowFromRightLeaf(InnerNode* parent, size_type index) {
+            NodeBase* node = parent->children[index];
+            NodeBase* right = parent->children[index + 1];
+
+            node->keys[node->count++] = right->keys[0];
+            RemoveKey(right, 0);
+            parent->keys[index] = right->keys[0];
+        }
+
+        void BorrowFromLeftLeaf(InnerNode* parent, size_type index) {
+            NodeBase* node = parent->children[index];
+            NodeBase* left = parent->children[index - 1];
+
+            InsertKey(node, 0, left->keys[left->count - 1]);
+            RemoveKey(left, left->count - 1);
+            parent->keys[index - 1] = node->keys[0];
+        }
+
+        void BorrowFromRightInner(InnerNode* parent, size_type index) {
+            auto* node = static_cast<InnerNode*>(parent->children[index]);
+            auto* right = static_cast<InnerNode*>(parent->children[index + 1]);
+
+            node->keys[node->count] = parent->keys[index];
+            node->children[node->count + 1] = right->children[0];
+            ++node->count;
+
+            parent->keys[index] = right->keys[0];
+            std::copy(right->children + 1, right->children + right->count + 1, right->children);
+            right->children[right->count] = nullptr;
+            RemoveKey(right, 0);
+        }
+
+        void BorrowFromLeftInner(InnerNode* parent, size_type index) {
+            auto* node = static_cast<InnerNode*>(parent->children[index]);
+            auto* left = static_cast<InnerNode*>(parent->children[index - 1]);
+
+            std::copy_backward(node->children, node->children + node->count + 1, node->children + node->count + 2);
+            InsertKey(node, 0, parent->keys[index - 1]);
+            node->children[0] = left->children[left->count];
+
+            parent->keys[index - 1] = left->keys[left->count - 1];
+            left->children[left->count] = nullptr;
+            RemoveKey(left, left->count - 1);
+        }
+
+        void MergeLeaves(InnerNode* parent, size_type left_index) {
+            auto* left = static_cast<LeafNode*>(parent->children[left_index]);
+            auto* right = static_cast<LeafNode*>(parent->children[left_index + 1]);
+
+            std::copy_n(right->keys, right->count, left->keys + left->count);
+            left->count += right->count;
+
+            left->next = right->next;
+            if (right->next == nullptr) {
+                last_leaf_ = left;
+            } else {
+                right->next->previous = left;
+            }
+
+            RemoveRoute(parent, left_index);
+            DestroyLeaf(right);
+        }
+
+        void MergeInner(InnerNode* parent, size_type left_index) {
+            auto* left = static_cast<InnerNode*>(parent->children[left_index]);
+            auto* right = static_cast<InnerNode*>(parent->children[left_index + 1]);
+
+            left->keys[left->count] = parent->keys[left_index];
+            std::copy_n(right->keys, right->count, left->keys + left->count + 1);
+            std::copy_n(right->children, right->count + 1, left->children + left->count + 1);
+            left->count += right->count + 1;
+
+            RemoveRoute(parent, left_index);
+            DestroyInner(right);
+        }
+
+        // An inner root left with a single child hands the root over to it, an empty leaf root goes away
+        void ShrinkRoot() {
+            if (height_ > 0 && root_->count == 0) {
+                auto* old_root = static_cast<InnerNode*>(root_);
+                root_ = old_root->children[0];
+                --height_;
+                DestroyInner(old_root);
+            } else if (height_ == 0 && root_->count == 0) {
+                DestroyLeaf(static_cast<LeafNode*>(root_));
+                root_ = nullptr;
+                first_leaf_ = nullptr;
+                last_leaf_ = nullptr;
+            }
+        }
+
+        void InsertKey(NodeBase* node, size_type index, const key_type& key_value) {
+            std::copy_backward(node->keys + index, node->keys + node->count, node->keys + node->count + 1);
+            node->keys[index] = key_value;
+            ++node->count;
+        }
+
+        void RemoveKey(NodeBase* node, size_type index) {
+            std::copy(node->keys + index + 1, node->keys + node->count, node->keys + index);
+            --node->count;
+            ClearSlot(node, node->count);
+        }
+
+        void InsertRoute(InnerNode* inner, size_type index, const key_type& separator, NodeBase* right_node) {
+            std::copy_backward(inner->children + index + 1, inner->children + inner->count + 1, inner->children + inner->count + 2);
+            inner->children[index + 1] = right_node;
+            InsertKey(inner, index, separator);
+        }
+
+        // Drops keys[index] and the child to its right
+        void RemoveRoute(InnerNode* inner, size_type index) {
+            std::copy(inner->children + index + 2, inner->children + inner->count + 1, inner->children + index + 1);
+            inner->children[inner->count] = nullptr;
+            RemoveKey(inner, index);
+        }
+
+        void AssignRoutes(InnerNode* inner, const key_type* keys, NodeBase* const* children, size_type count) {
+            std::copy_n(keys, count, inner->keys);
+            std::copy_n(children, count + 1, inner->children);
+            for (size_type i = count; i < kCapacity; ++i) {
+                ClearSlot(inner, i);
+                inner->children[i + 1] = nullptr;
+            }
+            inner->count = count;
+        }
+
+        void MoveTail(NodeBase* from, NodeBase* to, size_type keep) {
+            std::copy(from->keys + keep, from->keys + from->count, to->keys);
+            to->count = from->count - keep;
+            for (size_type i = keep; i < from->count; ++i) {
+                ClearSlot(from, i);
+            }
+            from->count = keep;
+        }
+
+        void ClearSlot(NodeBase* node, size_type index) {
+            if constexpr (kCountingSearch) {
+                node->keys[index] = detail::SentinelKey<Key>();
+            } else {
+                node->keys[index] = key_type{};
+            }
+        }
+
+        // Leaves are reached left to right, so the leaf chain is rebuilt on the way
+        NodeBase* CloneSubtree(const NodeBase* node, size_type levels_below) {
+            if (levels_below == 0) {
+                LeafNode* leaf = ConstructLeaf();
+                std::copy_n(node->keys, kCapacity, leaf->keys);
+                leaf->count = node->count;
+                leaf->previous = last_leaf_;
+                if (last_leaf_ == nullptr) {
+                    first_leaf_ = leaf;
+                } else {
+                    last_leaf_->next = leaf;
+                }
+                last_leaf_ = leaf;
+
+                return leaf;
+            }
+
+            const auto* inner = static_cast<const InnerNode*>(node);
+            InnerNode* copy = ConstructInner();
+            std::copy_n(inner->keys, kCapacity, copy->keys);
+            copy->count = inner->count;
+            for (size_type i = 0; i <= inner->count; ++i) {
+                copy->children[i] = CloneSubtree(inner->children[i], levels_below - 1);
+            }
+
+            return copy;
+        }
+
+        void DestroySubtree(NodeBase* node, size_type levels_below) {
+            if (levels_below == 0) {
+                DestroyLeaf(static_cast<LeafNode*>(node));
+                return;
+            }
+
+            auto* inner = static_cast<InnerNode*>(node);
+            for (size_type i = 0; i <= inner->count; ++i) {
+                DestroySubtree(inner->children[i], levels_below - 1);
+            }
+            DestroyInner(inner);
+        }
+
+        LeafNode* ConstructLeaf() {
+            leaf_allocator_type leaf_allocator(allocator_);
+            LeafNode* leaf = leaf_allocator_traits::allocate(leaf_allocator, 1);
+            leaf_allocator_traits::construct(leaf_allocator, leaf);
+
+            return leaf;
+        }
+
+        InnerNode* ConstructInner() {
+            inner_allocator_type inner_allocator(allocator_);
+            InnerNode* inner = inner_allocator_traits::allocate(inner_allocator, 1);
+            inner_allocator_traits::construct(inner_allocator, inner);
+
+            return inner;
+        }
+
+        void DestroyLeaf(LeafNode* leaf) {
+            leaf_allocator_type leaf_allocator(allocator_);
+            leaf_allocator_traits::destroy(leaf_allocator, leaf);
+            leaf_allocator_traits::deallocate(leaf_allocator, leaf, 1);
+        }
+
+        void DestroyInner(InnerNode* inner) {
+            inner_allocator_type inner_allocator(allocator_);
+            inner_allocator_traits::destroy(inner_allocator, inner);
+            inner_allocator_traits::deallocate(inner_allocator, inner, 1);
+        }
+    };
+
+    // Picks the wide-node tree where its counting search applies (arithmetic keys under operator<),
+    // the balanced binary tree otherwise
+    template<typename Key, typename Comparator = std::less<Key>, typename Allocator = std::allocator<Key>>
+    using OrderedSet = std::conditional_t<detail::CountingSearchKey<Key, Comparator>,
+            BPlusTree<Key, Comparator, Allocator>,
+            BinarySearchTree<Key, InOrderTraversal, Comparator,
+                    typename std::allocator_traits<Allocator>::template rebind_alloc<Node<Key>>, RedBlackBalancing>>;
+}
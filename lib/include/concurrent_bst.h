@@ -0,0 +1,478 @@
+#pragma once
+#include "epoch.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace BST {
+    // Ordered set shared between threads. Published nodes are never modified: a writer copies the path
+    // it changes (AVL-balanced) and swings the root with one atomic store, so find, contains and
+    // lower_bound walk a consistent version of the tree without taking any lock. Writers serialize on a
+    // mutex. Replaced nodes are retired to an EpochDomain and freed once every reader that could still
+    // see them has left
+    template<typename Key, typename Comparator = std::less<Key>, typename Allocator = std::allocator<Key>>
+    class ConcurrentBinarySearchTree {
+        struct Node {
+            Key key;
+            const Node* left = nullptr;
+            const Node* right = nullptr;
+            int height = 1;
+            std::uint64_t generation = 0; // write that created the node
+        };
+
+        using node_allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+        using node_allocator_traits = std::allocator_traits<node_allocator_type>;
+        using epoch_domain_type = EpochDomain<Node, node_allocator_type>;
+
+        // An AVL tree over fewer than 2^64 keys is less than 1.45 * 64 levels deep
+        static constexpr std::size_t kMaxHeight = 96;
+    public:
+        // Consistent version of the tree for long scans: the pinned epoch keeps every node of this
+        // version allocated while writers go on, so nothing is copied up front. Writers keep retiring
+        // nodes meanwhile and nothing is freed until the snapshot is released, so it should not be
+        // held longer than the scan
+        class Snapshot {
+        public:
+            // In-order iterator over a snapshot. The persistent nodes have no parent links, so it
+            // carries the path from the root
+            class Iterator {
+            public:
+                using value_type = Key;
+                using pointer = const value_type*;
+                using reference = const value_type&;
+                using difference_type = std::ptrdiff_t;
+                using iterator_category = std::forward_iterator_tag;
+
+                Iterator() = default;
+
+                explicit Iterator(const Node* root) {
+                    PushLeftSpine(root);
+                }
+
+                bool operator==(const Iterator& rhs_iter) const {
+                    return depth_ == rhs_iter.depth_ && (depth_ == 0 || path_[depth_ - 1] == rhs_iter.path_[depth_ - 1]);
+                }
+
+                bool operator!=(const Iterator& rhs_iter) const {
+                    return !(operator==(rhs_iter));
+                }
+
+                Iterator& operator++() {
+                    const Node* node = path_[--depth_];
+                    PushLeftSpine(node->right);
+
+                    return *this;
+                }
+
+                Iterator operator++(int) {
+                    auto temp_iter = *this;
+                    ++*this;
+
+                    return temp_iter;
+                }
+
+                reference operator*() const {
+                    return path_[depth_ - 1]->key;
+                }
+
+                pointer operator->() const {
+                    return &path_[depth_ - 1]->key;
+                }
+            private:
+                const Node* path_[kMaxHeight] = {};
+                std::size_t depth_ = 0;
+
+                void PushLeftSpine(const Node* node) {
+                    for (; node != nullptr; node = node->left) {
+                        path_[depth_++] = node;
+                    }
+                }
+            };
+
+            using iterator = Iterator;
+            using const_iterator = Iterator;
+
+            iterator begin() const {
+                return iterator(root_);
+            }
+
+            iterator end() const {
+                return iterator();
+            }
+
+            [[nodiscard]] bool empty() const {
+                return root_ == nullptr;
+            }
+        private:
+            friend class ConcurrentBinarySearchTree;
+
+            Snapshot(typename epoch_domain_type::Guard guard, const Node* root) : guard_(std::move(guard)), root_(root) {};
+
+            typename epoch_domain_type::Guard guard_;
+            const Node* root_ = nullptr;
+        };
+
+        using key_type = Key;
+        using value_type = Key;
+        using key_compare = Comparator;
+        using value_compare = Comparator;
+        using allocator_type = Allocator;
+        using size_type = std::size_t;
+
+        ConcurrentBinarySearchTree() = default;
+
+        ConcurrentBinarySearchTree(const std::initializer_list<key_type>& values_list) : ConcurrentBinarySearchTree() {
+            for (const auto& key_value : values_list) {
+                insert(key_value);
+            }
+        }
+
+        ConcurrentBinarySearchTree(const ConcurrentBinarySearchTree&) = delete;
+
+        ConcurrentBinarySearchTree& operator=(const ConcurrentBinarySearchTree&) = delete;
+
+        // No thread may use the tree while it is destroyed
+        ~ConcurrentBinarySearchTree() {
+            DestroySubtree(root_.load());
+        }
+
+        [[nodiscard]] size_type size() const {
+            return size_.load();
+        }
+
+        [[nodiscard]] bool empty() const {
+            return size() == 0;
+        }
+
+        [[nodiscard]] key_compare key_comp() const {
+            return comparator_;
+        }
+
+        [[nodiscard]] allocator_type get_allocator() const {
+            return allocator_type(allocator_);
+        }
+
+        // Lookups return copies of the keys: a node may be reclaimed as soon as the lookup returns
+        bool contains(const key_type& key_value) const {
+            auto guard = epochs_.pin();
+
+            return FindNode(root_.load(), key_value) != nullptr;
+        }
+
+        std::optional<key_type> find(const key_type& key_value) const {
+            auto guard = epochs_.pin();
+            const Node* node = FindNode(root_.load(), key_value);
+            if (node == nullptr) return std::nullopt;
+
+            return node->key;
+        }
+
+        std::optional<key_type> lower_bound(const key_type& key_value) const {
+            auto guard = epochs_.pin();
+            const Node* node = root_.load();
+            const Node* bound = nullptr;
+            while (node != nullptr) {
+                if (comparator_(node->key, key_value)) {
+                    node = node->right;
+                } else {
+                    bound = node;
+                    node = node->left;
+                }
+            }
+            if (bound == nullptr) return std::nullopt;
+
+            return bound->key;
+        }
+
+        // Never blocks writers; see Snapshot for how long it should be kept
+        [[nodiscard]] Snapshot snapshot() const {
+            auto guard = epochs_.pin();
+            const Node* root = root_.load();
+
+            return Snapshot(std::move(guard), root);
+        }
+
+        bool insert(const key_type& key_value) {
+            std::lock_guard<std::mutex> lock(writer_mutex_);
+            BeginWrite();
+
+            bool inserted = false;
+            const Node* new_root = nullptr;
+            try {
+                new_root = Insert(root_.load(), key_value, inserted);
+            } catch (...) {
+                AbortWrite();
+                throw;
+            }
+            if (inserted) {
+                root_.store(new_root);
+                size_.fetch_add(1);
+            }
+            EndWrite();
+
+            return inserted;
+        }
+
+        size_type erase(const key_type& key_value) {
+            std::lock_guard<std::mutex> lock(writer_mutex_);
+            BeginWrite();
+
+            bool erased = false;
+            const Node* new_root = nullptr;
+            try {
+                new_root = Erase(root_.load(), key_value, erased);
+            } catch (...) {
+                AbortWrite();
+                throw;
+            }
+            if (erased) {
+                root_.store(new_root);
+                size_.fetch_sub(1);
+            }
+            EndWrite();
+
+            return erased;
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(writer_mutex_);
+            BeginWrite();
+
+            const Node* old_root = root_.exchange(nullptr);
+            size_.store(0);
+            RetireSubtree(old_root);
+            EndWrite();
+        }
+    private:
+        static constexpr std::size_t kReclaimThreshold = 1024;
+        // Per level a write copies the path node and rebalances with at most a double rotation
+        static constexpr std::size_t kMaxNodesPerWrite = 6 * kMaxHeight + 2;
+
+        std::atomic<const Node*> root_ = nullptr;
+        std::atomic<size_type> size_ = 0;
+        key_compare comparator_;
+        node_allocator_type allocator_;
+        epoch_domain_type epochs_{allocator_};
+
+        // Writer state, guarded by writer_mutex_
+        std::mutex writer_mutex_;
+        std::uint64_t generation_ = 0;
+        const Node* created_[kMaxNodesPerWrite] = {};
+        std::size_t created_count_ = 0;
+        const Node* discarded_[kMaxNodesPerWrite] = {};
+        std::size_t discarded_count_ = 0;
+
+        const Node* FindNode(const Node* node, const key_type& key_value) const {
+            while (node != nullptr) {
+                if (comparator_(key_value, node->key)) {
+                    node = node->left;
+                } else if (comparator_(node->key, key_value)) {
+                    node = node->right;
+                } else {
+                    return node;
+                }
+            }
+
+            return nullptr;
+        }
+
+        void BeginWrite() {
+            ++generation_;
+            created_count_ = 0;
+            discarded_count_ = 0;
+        }
+
+        // Runs after the new root is published: nodes retired from now on are unreachable for new readers.
+        // A node built during this write was never published and goes away at once, a published one is
+        // retired until the readers that might hold it are gone
+        void EndWrite() {
+            for (std::size_t i = 0; i < discarded_count_; ++i) {
+                auto* node = const_cast<Node*>(discarded_[i]);
+                if (node->generation == generation_) {
+                    DestroyNode(node);
+                } else {
+                    epochs_.retire(node);
+                }
+            }
+            discarded_count_ = 0;
+
+            if (epochs_.pending() >= kReclaimThreshold) {
+                epochs_.collect();
+            }
+        }
+
+        static int Height(const Node* node) {
+            return (node == nullptr) ? 0 : node->height;
+        }
+
+        // A write that throws never published anything: the tree keeps the old root, so every node built
+        // during the write goes away and the discarded ones stay where they are
+        void AbortWrite() {
+            for (std::size_t i = 0; i < created_count_; ++i) {
+                DestroyNode(const_cast<Node*>(created_[i]));
+            }
+            created_count_ = 0;
+            discarded_count_ = 0;
+        }
+
+        // The key is copied once, straight into the node
+        const Node* Make(const key_type& key_value, const Node* left, const Node* right) {
+            Node* node = node_allocator_traits::allocate(allocator_, 1);
+            try {
+                node_allocator_traits::construct(allocator_, node, key_value, left, right, std::max(Height(left), Height(right)) + 1, generation_);
+            } catch (...) {
+                node_allocator_traits::deallocate(allocator_, node, 1);
+                throw;
+            }
+            created_[created_count_++] = node;
+
+            return node;
+        }
+
+        // Nodes dropped from the new version are only freed or retired by EndWrite, once it is published
+        void Discard(const Node* node) {
+            discarded_[discarded_count_++] = node;
+        }
+
+        const Node* RotateRight(const Node* node) {
+            const Node* left = node->left;
+            const Node* result = Make(left->key, left->left, Make(node->key, left->right, node->right));
+            Discard(left);
+            Discard(node);
+
+            return result;
+        }
+
+        const Node* RotateLeft(const Node* node) {
+            const Node* right = node->right;
+            const Node* result = Make(right->key, Make(node->key, node->left, right->left), right->right);
+            Discard(right);
+            Discard(node);
+
+            return result;
+        }
+
+        // node is a fresh copy whose subtrees differ in height by at most two
+        const Node* Rebalance(const Node* node) {
+            int balance = Height(node->left) - Height(node->right);
+            if (balance > 1) {
+                if (Height(node->left->left) < Height(node->left->right)) {
+                    const Node* rotated = Make(node->key, RotateLeft(node->left), node->right);
+                    Discard(node);
+                    node = rotated;
+                }
+
+                return RotateRight(node);
+            }
+            if (balance < -1) {
+                if (Height(node->right->right) < Height(node->right->left)) {
+                    const Node* rotated = Make(node->key, node->left, RotateRight(node->right));
+                    Discard(node);
+                    node = rotated;
+                }
+
+                return RotateLeft(node);
+            }
+
+            return node;
+        }
+
+        const Node* Insert(const Node* node, const key_type& key_value, bool& inserted) {
+            if (node == nullptr) {
+                inserted = true;
+
+                return Make(key_value, nullptr, nullptr);
+            }
+
+            const Node* copy;
+            if (comparator_(key_value, node->key)) {
+                const Node* left = Insert(node->left, key_value, inserted);
+                if (!inserted) return node;
+                copy = Make(node->key, left, node->right);
+            } else if (comparator_(node->key, key_value)) {
+                const Node* right = Insert(node->right, key_value, inserted);
+                if (!inserted) return node;
+                copy = Make(node->key, node->left, right);
+            } else {
+                return node;
+            }
+            Discard(node);
+
+            return Rebalance(copy);
+        }
+
+        const Node* Erase(const Node* node, const key_type& key_value, bool& erased) {
+            if (node == nullptr) return nullptr;
+
+            const Node* copy;
+            if (comparator_(key_value, node->key)) {
+                const Node* left = Erase(node->left, key_value, erased);
+                if (!erased) return node;
+                copy = Make(node->key, left, node->right);
+            } else if (comparator_(node->key, key_value)) {
+                const Node* right = Erase(node->right, key_value, erased);
+                if (!erased) return node;
+                copy = Make(node->key, node->left, right);
+            } else {
+                erased = true;
+                if (node->left == nullptr || node->right == nullptr) {
+                    const Node* child = (node->left == nullptr) ? node->right : node->left;
+                    Discard(node);
+
+                    return child;
+                }
+
+                const Node* successor = nullptr;
+                const Node* right = RemoveMin(node->right, successor);
+                copy = Make(successor->key, node->left, right);
+                Discard(successor);
+            }
+            Discard(node);
+
+            return Rebalance(copy);
+        }
+
+        // Detaches the minimum of the subtree and hands it out through min_node, which the caller discards
+        const Node* RemoveMin(const Node* node, const Node*& min_node) {
+            if (node->left == nullptr) {
+                min_node = node;
+
+                return node->right;
+            }
+
+            const Node* copy = Make(node->key, RemoveMin(node->left, min_node), node->right);
+            Discard(node);
+
+            return Rebalance(copy);
+        }
+
+        void RetireSubtree(const Node* node) {
+            if (node == nullptr) return;
+
+            RetireSubtree(node->left);
+            RetireSubtree(node->right);
+            epochs_.retire(const_cast<Node*>(node));
+        }
+
+        void DestroySubtree(const Node* node) {
+            if (node == nullptr) return;
+
+            DestroySubtree(node->left);
+            DestroySubtree(node->right);
+            DestroyNode(const_cast<Node*>(node));
+        }
+
+        void DestroyNode(Node* node) {
+            node_allocator_traits::destroy(allocator_, node);
+            node_allocator_traits::deallocate(allocator_, node, 1);
+        }
+    };
+}
@@ -0,0 +1,187 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace BST {
+    // Epoch-based reclamation for nodes shared with lock-free readers. A reader pins the current epoch
+    // for as long as it may hold pointers into the structure; a writer retires the objects it unlinks
+    // and collect() frees them once every reader pinned before the unlink has left.
+    //
+    // Retired objects are kept in fixed-size batches stamped with the epoch at which the batch was
+    // closed, so reclamation walks and frees whole batches. retire() and collect() must be serialized
+    // by the caller (the structure's writer lock); pin() may be called from any thread
+    template<typename T, typename Allocator = std::allocator<T>>
+    class EpochDomain {
+        static constexpr std::uint64_t kIdle = std::numeric_limits<std::uint64_t>::max();
+        static constexpr std::size_t kReaderSlots = 128;
+        static constexpr std::size_t kBatchSize = 256;
+
+        // One cache line per slot, so readers entering and leaving do not contend
+        struct alignas(64) ReaderSlot {
+            std::atomic<std::uint64_t> epoch{kIdle};
+        };
+
+        struct RetireBatch {
+            T* objects[kBatchSize];
+            std::size_t count = 0;
+            std::uint64_t epoch = 0;
+            RetireBatch* next = nullptr;
+        };
+    public:
+        using allocator_type = Allocator;
+        using size_type = std::size_t;
+
+        // Read-side critical section: objects reachable when the guard was taken stay allocated until
+        // it is released. A moved-from guard holds nothing
+        class Guard {
+        public:
+            Guard() = default;
+
+            Guard(const Guard&) = delete;
+
+            Guard& operator=(const Guard&) = delete;
+
+            Guard(Guard&& other) noexcept : slot_(std::exchange(other.slot_, nullptr)) {};
+
+            Guard& operator=(Guard&& other) noexcept {
+                std::swap(slot_, other.slot_);
+
+                return *this;
+            }
+
+            ~Guard() {
+                if (slot_ != nullptr) {
+                    slot_->epoch.store(kIdle);
+                }
+            }
+        private:
+            friend class EpochDomain;
+
+            explicit Guard(ReaderSlot* slot) : slot_(slot) {};
+
+            ReaderSlot* slot_ = nullptr;
+        };
+
+        explicit EpochDomain(const allocator_type& allocator = allocator_type()) : allocator_(allocator) {};
+
+        EpochDomain(const EpochDomain&) = delete;
+
+        EpochDomain& operator=(const EpochDomain&) = delete;
+
+        // No guard may outlive the domain, so everything still retired can go
+        ~EpochDomain() {
+            CloseBatch();
+            FreeBatches(closed_);
+        }
+
+        // Claims a free reader slot stamped with the current epoch. Readers load the structure's root
+        // only after pinning
+        [[nodiscard]] Guard pin() const {
+            std::size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id());
+            for (std::size_t attempt = 0;; ++attempt) {
+                ReaderSlot* slot = &reader_slots_[(start + attempt) % kReaderSlots];
+                std::uint64_t expected = kIdle;
+                if (slot->epoch.compare_exchange_strong(expected, epoch_.load())) return Guard(slot);
+                if (attempt % kReaderSlots == kReaderSlots - 1) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        // The object must be unreachable for readers that pin after the next collect() starts
+        void retire(T* object) {
+            if (open_ == nullptr || open_->count == kBatchSize) {
+                CloseBatch();
+                open_ = ConstructBatch();
+            }
+
+            open_->objects[open_->count++] = object;
+            ++pending_;
+        }
+
+        // Frees the batches retired before the oldest epoch still pinned. The epoch only advances here
+        void collect() {
+            CloseBatch();
+
+            std::uint64_t oldest = epoch_.fetch_add(1) + 1;
+            for (const auto& slot : reader_slots_) {
+                oldest = std::min(oldest, slot.epoch.load());
+            }
+
+            RetireBatch** link = &closed_;
+            while (*link != nullptr && (*link)->epoch >= oldest) {
+                link = &(*link)->next;
+            }
+
+            RetireBatch* reclaimable = *link;
+            *link = nullptr;
+            FreeBatches(reclaimable);
+        }
+
+        // Objects retired and not yet freed
+        [[nodiscard]] size_type pending() const {
+            return pending_;
+        }
+    private:
+        using object_allocator_traits = std::allocator_traits<allocator_type>;
+        using batch_allocator_type = typename object_allocator_traits::template rebind_alloc<RetireBatch>;
+        using batch_allocator_traits = std::allocator_traits<batch_allocator_type>;
+
+        std::atomic<std::uint64_t> epoch_ = 0;
+        mutable ReaderSlot reader_slots_[kReaderSlots];
+        allocator_type allocator_;
+
+        // Writer state
+        RetireBatch* open_ = nullptr;
+        RetireBatch* closed_ = nullptr; // newest first, so batch epochs never increase along the list
+        size_type pending_ = 0;
+
+        // Stamping the batch with the current epoch is conservative: nothing in it was retired later
+        void CloseBatch() {
+            if (open_ == nullptr) return;
+
+            if (open_->count == 0) {
+                DestroyBatch(open_);
+            } else {
+                open_->epoch = epoch_.load();
+                open_->next = closed_;
+                closed_ = open_;
+            }
+            open_ = nullptr;
+        }
+
+        void FreeBatches(RetireBatch* batch) {
+            while (batch != nullptr) {
+                RetireBatch* next = batch->next;
+                for (std::size_t i = 0; i < batch->count; ++i) {
+                    object_allocator_traits::destroy(allocator_, batch->objects[i]);
+                    object_allocator_traits::deallocate(allocator_, batch->objects[i], 1);
+                }
+                pending_ -= batch->count;
+                DestroyBatch(batch);
+                batch = next;
+            }
+        }
+
+        RetireBatch* ConstructBatch() {
+            batch_allocator_type batch_allocator(allocator_);
+            RetireBatch* batch = batch_allocator_traits::allocate(batch_allocator, 1);
+            batch_allocator_traits::construct(batch_allocator, batch);
+
+            return batch;
+        }
+
+        void DestroyBatch(RetireBatch* batch) {
+            batch_allocator_type batch_allocator(allocator_);
+            batch_allocator_traits::destroy(batch_allocator, batch);
+            batch_allocator_traits::deallocate(batch_allocator, batch, 1);
+        }
+    };
+}
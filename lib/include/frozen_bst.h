@@ -0,0 +1,369 @@
+#pragma once
+#include "bst.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+namespace BST {
+    // Read-only snapshot of a BinarySearchTree. Keys are stored in one array in Eytzinger (BFS) order:
+    // the children of index k are 2k and 2k + 1, so a search is a branchless walk over one allocation
+    // and the next levels can be prefetched while the current one is compared
+    template<typename Key, typename Comparator = std::less<Key>, typename Allocator = std::allocator<Key>>
+    class FrozenBinarySearchTree {
+    public:
+        class Iterator {
+        public:
+            using value_type = Key;
+            using pointer = const value_type*;
+            using reference = const value_type&;
+            using difference_type = std::ptrdiff_t;
+            using iterator_category = std::bidirectional_iterator_tag;
+
+            Iterator() = default;
+
+            explicit Iterator(const Key* keys, std::size_t size, std::size_t index) : keys_(keys), size_(size), index_(index) {};
+
+            bool operator==(const Iterator& rhs_iter) const {
+                return index_ == rhs_iter.index_;
+            }
+
+            bool operator!=(const Iterator& rhs_iter) const {
+                return !(operator==(rhs_iter));
+            }
+
+            // In-order successor in the implicit tree: leftmost node of the right subtree, otherwise the
+            // first ancestor reached from a left child. Index 0 is end()
+            Iterator& operator++() {
+                if (2 * index_ + 1 <= size_) {
+                    index_ = 2 * index_ + 1;
+                    while (2 * index_ <= size_) {
+                        index_ = 2 * index_;
+                    }
+                } else {
+                    index_ >>= std::countr_one(index_) + 1;
+                }
+
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                auto temp_iter = *this;
+                ++*this;
+
+                return temp_iter;
+            }
+
+            Iterator& operator--() {
+                if (index_ == 0) {
+                    index_ = (size_ == 0) ? 0 : 1;
+                    while (index_ != 0 && 2 * index_ + 1 <= size_) {
+                        index_ = 2 * index_ + 1;
+                    }
+                } else if (2 * index_ <= size_) {
+                    index_ = 2 * index_;
+                    while (2 * index_ + 1 <= size_) {
+                        index_ = 2 * index_ + 1;
+                    }
+                } else {
+                    index_ >>= std::countr_zero(index_) + 1;
+                }
+
+                return *this;
+            }
+
+            Iterator operator--(int) {
+                auto temp_iter = *this;
+                --*this;
+
+                return temp_iter;
+            }
+
+            reference operator*() const {
+                return keys_[index_];
+            }
+
+            pointer operator->() const {
+                return keys_ + index_;
+            }
+        private:
+            const Key* keys_ = nullptr;
+            std::size_t size_ = 0;
+            std::size_t index_ = 0;
+        };
+
+        using key_type = Key;
+        using value_type = Key;
+        using key_compare = Comparator;
+        using value_compare = Comparator;
+        using allocator_type = Allocator;
+        using allocator_traits = std::allocator_traits<allocator_type>;
+        using size_type = std::size_t;
+        using difference_type = std::ptrdiff_t;
+        using reference = const value_type&;
+        using const_reference = const value_type&;
+        using iterator = Iterator;
+        using const_iterator = Iterator;
+        using reverse_iterator = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+        FrozenBinarySearchTree() = default;
+
+        // In-order trees are placed straight from their iterators. Pre- and post-order trees do not iterate
+        // in key order, their keys are copied and sorted once up front
+        template<typename TraversalTag, typename TreeAllocator, typename... Policies>
+        explicit FrozenBinarySearchTree(const BinarySearchTree<Key, TraversalTag, Comparator, TreeAllocator, Policies...>& tree,
+                                        const allocator_type& allocator = allocator_type())
+                : comparator_(tree.key_comp()), allocator_(allocator) {
+            if (tree.empty()) return;
+
+            if constexpr (std::is_same_v<TraversalTag, InOrderTraversal>) {
+                Build(tree.begin(), tree.size());
+            } else {
+                Key* sorted_keys = allocator_traits::allocate(allocator_, tree.size());
+                try {
+                    std::uninitialized_copy(tree.begin(), tree.end(), sorted_keys);
+                } catch (...) {
+                    allocator_traits::deallocate(allocator_, sorted_keys, tree.size());
+                    throw;
+                }
+
+                try {
+                    std::sort(sorted_keys, sorted_keys + tree.size(), comparator_);
+                    Build(sorted_keys, tree.size());
+                } catch (...) {
+                    std::destroy_n(sorted_keys, tree.size());
+                    allocator_traits::deallocate(allocator_, sorted_keys, tree.size());
+                    throw;
+                }
+                std::destroy_n(sorted_keys, tree.size());
+                allocator_traits::deallocate(allocator_, sorted_keys, tree.size());
+            }
+        }
+
+        FrozenBinarySearchTree(const FrozenBinarySearchTree& other)
+                : comparator_(other.comparator_), allocator_(allocator_traits::select_on_container_copy_construction(other.allocator_)) {
+            if (other.size_ == 0) return;
+
+            Key* keys = allocator_traits::allocate(allocator_, other.size_ + 1);
+            try {
+                std::uninitialized_copy_n(other.keys_ + 1, other.size_, keys + 1);
+            } catch (...) {
+                allocator_traits::deallocate(allocator_, keys, other.size_ + 1);
+                throw;
+            }
+            keys_ = keys;
+            size_ = other.size_;
+        }
+
+        FrozenBinarySearchTree(FrozenBinarySearchTree&& other) noexcept
+                : keys_(std::exchange(other.keys_, nullptr)), size_(std::exchange(other.size_, 0)),
+                  comparator_(std::move(other.comparator_)), allocator_(std::move(other.allocator_)) {};
+
+        ~FrozenBinarySearchTree() {
+            Release();
+        }
+
+        FrozenBinarySearchTree& operator=(FrozenBinarySearchTree rhs) noexcept {
+            swap(rhs);
+
+            return *this;
+        }
+
+        iterator begin() const {
+            size_type index = (size_ == 0) ? 0 : 1;
+            while (index != 0 && 2 * index <= size_) {
+                index = 2 * index;
+            }
+
+            return iterator(keys_, size_, index);
+        }
+
+        iterator end() const {
+            return iterator(keys_, size_, 0);
+        }
+
+        const_iterator cbegin() const {
+            return begin();
+        }
+
+        const_iterator cend() const {
+            return end();
+        }
+
+        reverse_iterator rbegin() const {
+            return reverse_iterator(end());
+        }
+
+        reverse_iterator rend() const {
+            return reverse_iterator(begin());
+        }
+
+        [[nodiscard]] size_type size() const {
+            return size_;
+        }
+
+        [[nodiscard]] bool empty() const {
+            return size_ == 0;
+        }
+
+        [[nodiscard]] key_compare key_comp() const {
+            return comparator_;
+        }
+
+        [[nodiscard]] allocator_type get_allocator() const {
+            return allocator_;
+        }
+
+        iterator find(const key_type& key_value) const {
+            return iterator(keys_, size_, Find(key_value));
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        iterator find(const K& key_value) const {
+            return iterator(keys_, size_, Find(key_value));
+        }
+
+        size_type count(const key_type& key_value) const {
+            return Find(key_value) != 0;
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        size_type count(const K& key_value) const {
+            return Find(key_value) != 0;
+        }
+
+        bool contains(const key_type& key_value) const {
+            return count(key_value);
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        bool contains(const K& key_value) const {
+            return count(key_value);
+        }
+
+        iterator lower_bound(const key_type& key_value) const {
+            return iterator(keys_, size_, LowerBound(key_value));
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        iterator lower_bound(const K& key_value) const {
+            return iterator(keys_, size_, LowerBound(key_value));
+        }
+
+        iterator upper_bound(const key_type& key_value) const {
+            return iterator(keys_, size_, UpperBound(key_value));
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        iterator upper_bound(const K& key_value) const {
+            return iterator(keys_, size_, UpperBound(key_value));
+        }
+
+        void swap(FrozenBinarySearchTree& rhs) noexcept {
+            std::swap(keys_, rhs.keys_);
+            std::swap(size_, rhs.size_);
+            std::swap(comparator_, rhs.comparator_);
+            std::swap(allocator_, rhs.allocator_);
+        }
+
+        friend void swap(FrozenBinarySearchTree& lhs, FrozenBinarySearchTree& rhs) noexcept {
+            lhs.swap(rhs);
+        }
+    private:
+        // Index 0 is unused, so the root is at 1 and "no node" doubles as end()
+        Key* keys_ = nullptr;
+        size_type size_ = 0;
+        key_compare comparator_;
+        allocator_type allocator_;
+
+        // Four levels further down the descent, 16 consecutive indices, lie on one or two cache lines
+        static constexpr size_type kPrefetchStride = 16;
+
+        // On a throw the keys placed so far fill the first next_key in-order slots, which are destroyed
+        // before the array is given back
+        template<typename InputIt>
+        void Build(InputIt sorted_keys, size_type count) {
+            keys_ = allocator_traits::allocate(allocator_, count + 1);
+            size_ = count;
+
+            size_type next_key = 0;
+            try {
+                Place(sorted_keys, next_key, 1);
+            } catch (...) {
+                iterator placed = begin();
+                for (size_type i = 0; i < next_key; ++i, ++placed) {
+                    std::destroy_at(const_cast<Key*>(&*placed));
+                }
+                allocator_traits::deallocate(allocator_, keys_, count + 1);
+                keys_ = nullptr;
+                size_ = 0;
+                throw;
+            }
+        }
+
+        // The in-order walk over the implicit tree meets the indices in key order; the recursion is only
+        // as deep as the (complete) implicit tree
+        template<typename InputIt>
+        void Place(InputIt& sorted_keys, size_type& next_key, size_type index) {
+            if (index > size_) return;
+
+            Place(sorted_keys, next_key, 2 * index);
+            std::construct_at(keys_ + index, *sorted_keys);
+            ++sorted_keys;
+            ++next_key;
+            Place(sorted_keys, next_key, 2 * index + 1);
+        }
+
+        void Release() {
+            if (keys_ == nullptr) return;
+
+            std::destroy_n(keys_ + 1, size_);
+            allocator_traits::deallocate(allocator_, keys_, size_ + 1);
+            keys_ = nullptr;
+            size_ = 0;
+        }
+
+        void Prefetch(size_type index) const {
+#if defined(__GNUC__) || defined(__clang__)
+            if (index <= size_) {
+                __builtin_prefetch(keys_ + index);
+            }
+#endif
+        }
+
+        // Every step goes to 2k or 2k + 1 without a branch on the comparison. The walk ends below a leaf;
+        // the answer is the last node where it turned left, found by stripping the trailing right turns
+        template<typename K>
+        size_type LowerBound(const K& key_value) const {
+            size_type index = 1;
+            while (index <= size_) {
+                Prefetch(kPrefetchStride * index);
+                index = 2 * index + static_cast<size_type>(comparator_(keys_[index], key_value));
+            }
+
+            return index >> (std::countr_one(index) + 1);
+        }
+
+        template<typename K>
+        size_type UpperBound(const K& key_value) const {
+            size_type index = 1;
+            while (index <= size_) {
+                Prefetch(kPrefetchStride * index);
+                index = 2 * index + static_cast<size_type>(!comparator_(key_value, keys_[index]));
+            }
+
+            return index >> (std::countr_one(index) + 1);
+        }
+
+        template<typename K>
+        size_type Find(const K& key_value) const {
+            size_type index = LowerBound(key_value);
+
+            return (index != 0 && !comparator_(key_value, keys_[index])) ? index : 0;
+        }
+    };
+}
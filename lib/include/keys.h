@@ -0,0 +1,19 @@
+#pragma once
+#include "policy.h"
+
+namespace BST {
+    struct KeyPolicyTag {};
+
+    // Inserting a key equivalent to a present one is rejected
+    struct UniqueKeys {
+        using policy_category = KeyPolicyTag;
+        static constexpr bool kAllowsEquivalentKeys = false;
+    };
+
+    // Equivalent keys are all kept, in insertion order: a new key goes after its equivalents. count,
+    // equal_range and erase by key cover every equivalent
+    struct EquivalentKeys {
+        using policy_category = KeyPolicyTag;
+        static constexpr bool kAllowsEquivalentKeys = true;
+    };
+}
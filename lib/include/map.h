@@ -0,0 +1,415 @@
+#pragma once
+#include "bst.h"
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+namespace BST {
+    namespace detail {
+        // Orders map entries by their keys and compares entries with bare keys, so the tree's
+        // heterogeneous lookups find an entry from its key alone
+        template<typename Key, typename T, typename Comparator>
+        struct MapEntryCompare {
+            using is_transparent = void;
+            using value_type = std::pair<const Key, T>;
+
+            Comparator comparator;
+
+            bool operator()(const value_type& lhs, const value_type& rhs) const {
+                return comparator(lhs.first, rhs.first);
+            }
+
+            template<typename K>
+            bool operator()(const value_type& lhs, const K& rhs) const {
+                return comparator(lhs.first, rhs);
+            }
+
+            template<typename K>
+            bool operator()(const K& lhs, const value_type& rhs) const {
+                return comparator(lhs, rhs.first);
+            }
+        };
+
+        struct MapTreeAccess {
+            template<typename Tree, typename K, typename... Args>
+            static std::pair<typename Tree::iterator, bool> TryEmplace(Tree& tree, const K& key_value, Args&&... args) {
+                auto [node, inserted] = tree.TryEmplace(key_value, std::forward<Args>(args)...);
+
+                return {typename Tree::iterator(node, tree.begin_ptr_, tree.end_ptr_), inserted};
+            }
+        };
+    }
+
+    // Ordered key-value map on the same tree engine: each node holds a std::pair<const Key, T>, so a
+    // key and its value are found with one descent. Mapped values are constructed inside the node and
+    // can be modified through the iterators; keys stay const. Policies are passed on to the tree, and
+    // iteration is always in key order. The tree's sentinel holds a value-initialized entry, so Key and
+    // T must be default constructible. operator[], try_emplace and insert_or_assign assume one entry per
+    // key, so EquivalentKeys is rejected
+    template<typename Key, typename T, typename Comparator = std::less<Key>, typename Allocator = std::allocator<std::pair<const Key, T>>,
+             typename... Policies>
+        requires (!SelectPolicy<KeyPolicyTag, UniqueKeys, Policies...>::type::kAllowsEquivalentKeys)
+    class Map {
+    public:
+        using key_type = Key;
+        using mapped_type = T;
+        using value_type = std::pair<const Key, T>;
+        using key_compare = Comparator;
+        using allocator_type = Allocator;
+        using reference = value_type&;
+        using const_reference = const value_type&;
+    private:
+        using entry_compare = detail::MapEntryCompare<Key, T, Comparator>;
+        using tree_type = BinarySearchTree<value_type, InOrderTraversal, entry_compare,
+                typename std::allocator_traits<Allocator>::template rebind_alloc<Node<value_type>>, Policies...>;
+        using tree_iterator = typename tree_type::iterator;
+    public:
+        using size_type = typename tree_type::size_type;
+        using difference_type = typename tree_type::difference_type;
+
+        template<bool IsConst>
+        class Iterator {
+        public:
+            using value_type = Map::value_type;
+            using reference = std::conditional_t<IsConst, const value_type&, value_type&>;
+            using pointer = std::conditional_t<IsConst, const value_type*, value_type*>;
+            using difference_type = std::ptrdiff_t;
+            using iterator_category = std::bidirectional_iterator_tag;
+
+            Iterator() = default;
+
+            explicit Iterator(tree_iterator tree_iter) : tree_iter_(tree_iter) {};
+
+            template<bool OtherConst> requires (IsConst && !OtherConst)
+            Iterator(const Iterator<OtherConst>& other) : tree_iter_(other.tree_iter_) {};
+
+            template<bool OtherConst>
+            bool operator==(const Iterator<OtherConst>& rhs_iter) const {
+                return tree_iter_ == rhs_iter.tree_iter_;
+            }
+
+            Iterator& operator++() {
+                ++tree_iter_;
+
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                auto temp_iter = *this;
+                ++*this;
+
+                return temp_iter;
+            }
+
+            Iterator& operator--() {
+                --tree_iter_;
+
+                return *this;
+            }
+
+            Iterator operator--(int) {
+                auto temp_iter = *this;
+                --*this;
+
+                return temp_iter;
+            }
+
+            // The tree hands out const entries to protect the keys; the key of a pair<const Key, T> is
+            // const anyway, so only the mapped value becomes writable
+            reference operator*() const {
+                return const_cast<reference>(*tree_iter_);
+            }
+
+            pointer operator->() const {
+                return &operator*();
+            }
+        private:
+            tree_iterator tree_iter_;
+
+            template<bool>
+            friend class Iterator;
+
+            friend class Map;
+        };
+
+        using iterator = Iterator<false>;
+        using const_iterator = Iterator<true>;
+        using reverse_iterator = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+        Map() = default;
+
+        Map(const std::initializer_list<value_type>& values_list) {
+            insert(values_list.begin(), values_list.end());
+        }
+
+        template<std::input_iterator InputIt>
+        Map(InputIt it1, InputIt it2) {
+            insert(it1, it2);
+        }
+
+        iterator begin() {
+            return iterator(tree_.begin());
+        }
+
+        const_iterator begin() const {
+            return const_iterator(tree_.begin());
+        }
+
+        iterator end() {
+            return iterator(tree_.end());
+        }
+
+        const_iterator end() const {
+            return const_iterator(tree_.end());
+        }
+
+        const_iterator cbegin() const {
+            return begin();
+        }
+
+        const_iterator cend() const {
+            return end();
+        }
+
+        reverse_iterator rbegin() {
+            return reverse_iterator(end());
+        }
+
+        const_reverse_iterator rbegin() const {
+            return const_reverse_iterator(end());
+        }
+
+        reverse_iterator rend() {
+            return reverse_iterator(begin());
+        }
+
+        const_reverse_iterator rend() const {
+            return const_reverse_iterator(begin());
+        }
+
+        const_reverse_iterator crbegin() const {
+            return rbegin();
+        }
+
+        const_reverse_iterator crend() const {
+            return rend();
+        }
+
+        [[nodiscard]] size_type size() const {
+            return tree_.size();
+        }
+
+        [[nodiscard]] bool empty() const {
+            return tree_.empty();
+        }
+
+        [[nodiscard]] key_compare key_comp() const {
+            return tree_.key_comp().comparator;
+        }
+
+        [[nodiscard]] allocator_type get_allocator() const {
+            return allocator_type(tree_.get_allocator());
+        }
+
+        bool operator==(const Map& rhs) const {
+            return tree_ == rhs.tree_;
+        }
+
+        mapped_type& operator[](const key_type& key_value) {
+            return try_emplace(key_value).first->second;
+        }
+
+        mapped_type& operator[](key_type&& key_value) {
+            return try_emplace(std::move(key_value)).first->second;
+        }
+
+        mapped_type& at(const key_type& key_value) {
+            iterator found = find(key_value);
+            if (found == end()) throw std::out_of_range("Key is not in the map");
+
+            return found->second;
+        }
+
+        const mapped_type& at(const key_type& key_value) const {
+            const_iterator found = find(key_value);
+            if (found == end()) throw std::out_of_range("Key is not in the map");
+
+            return found->second;
+        }
+
+        // Nothing is constructed when the key is present; otherwise the mapped value is built from args
+        // inside the new node
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(const key_type& key_value, Args&&... args) {
+            return Wrap(detail::MapTreeAccess::TryEmplace(tree_, key_value, std::piecewise_construct, std::forward_as_tuple(key_value),
+                                                          std::forward_as_tuple(std::forward<Args>(args)...)));
+        }
+
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(key_type&& key_value, Args&&... args) {
+            return Wrap(detail::MapTreeAccess::TryEmplace(tree_, key_value, std::piecewise_construct, std::forward_as_tuple(std::move(key_value)),
+                                                          std::forward_as_tuple(std::forward<Args>(args)...)));
+        }
+
+        template<typename M>
+        std::pair<iterator, bool> insert_or_assign(const key_type& key_value, M&& object) {
+            auto result = try_emplace(key_value, std::forward<M>(object));
+            if (!result.second) {
+                result.first->second = std::forward<M>(object);
+            }
+
+            return result;
+        }
+
+        template<typename M>
+        std::pair<iterator, bool> insert_or_assign(key_type&& key_value, M&& object) {
+            auto result = try_emplace(std::move(key_value), std::forward<M>(object));
+            if (!result.second) {
+                result.first->second = std::forward<M>(object);
+            }
+
+            return result;
+        }
+
+        std::pair<iterator, bool> insert(const value_type& entry) {
+            return try_emplace(entry.first, entry.second);
+        }
+
+        std::pair<iterator, bool> insert(value_type&& entry) {
+            return Wrap(detail::MapTreeAccess::TryEmplace(tree_, entry.first, std::move(entry)));
+        }
+
+        template<std::input_iterator InputIt>
+        void insert(InputIt it1, InputIt it2) {
+            for (; it1 != it2; ++it1) {
+                insert(*it1);
+            }
+        }
+
+        // The entry is built inside a new node before the search, since the key is only known once it
+        // exists; the node is released again when the key is present
+        template<typename... Args>
+        std::pair<iterator, bool> emplace(Args&&... args) {
+            auto [tree_iter, inserted] = tree_.emplace(std::forward<Args>(args)...);
+
+            return {iterator(tree_iter), inserted};
+        }
+
+        template<typename... Args>
+        iterator emplace_hint(const_iterator hint, Args&&... args) {
+            return iterator(tree_.emplace_hint(hint.tree_iter_, std::forward<Args>(args)...));
+        }
+
+        iterator erase(const_iterator position) {
+            return iterator(tree_.erase(position.tree_iter_));
+        }
+
+        iterator erase(iterator position) {
+            return iterator(tree_.erase(position.tree_iter_));
+        }
+
+        size_type erase(const key_type& key_value) {
+            return tree_.erase(key_value);
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        size_type erase(const K& key_value) {
+            return tree_.erase(key_value);
+        }
+
+        void clear() {
+            tree_.clear();
+        }
+
+        iterator find(const key_type& key_value) {
+            return iterator(tree_.find(key_value));
+        }
+
+        const_iterator find(const key_type& key_value) const {
+            return const_iterator(tree_.find(key_value));
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        iterator find(const K& key_value) {
+            return iterator(tree_.find(key_value));
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        const_iterator find(const K& key_value) const {
+            return const_iterator(tree_.find(key_value));
+        }
+
+        size_type count(const key_type& key_value) const {
+            return tree_.count(key_value);
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        size_type count(const K& key_value) const {
+            return tree_.count(key_value);
+        }
+
+        bool contains(const key_type& key_value) const {
+            return tree_.contains(key_value);
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        bool contains(const K& key_value) const {
+            return tree_.contains(key_value);
+        }
+
+        iterator lower_bound(const key_type& key_value) {
+            return iterator(tree_.lower_bound(key_value));
+        }
+
+        const_iterator lower_bound(const key_type& key_value) const {
+            return const_iterator(tree_.lower_bound(key_value));
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        iterator lower_bound(const K& key_value) {
+            return iterator(tree_.lower_bound(key_value));
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        const_iterator lower_bound(const K& key_value) const {
+            return const_iterator(tree_.lower_bound(key_value));
+        }
+
+        iterator upper_bound(const key_type& key_value) {
+            return iterator(tree_.upper_bound(key_value));
+        }
+
+        const_iterator upper_bound(const key_type& key_value) const {
+            return const_iterator(tree_.upper_bound(key_value));
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        iterator upper_bound(const K& key_value) {
+            return iterator(tree_.upper_bound(key_value));
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        const_iterator upper_bound(const K& key_value) const {
+            return const_iterator(tree_.upper_bound(key_value));
+        }
+
+        void swap(Map& rhs) {
+            tree_.swap(rhs.tree_);
+        }
+
+        friend void swap(Map& lhs, Map& rhs) {
+            lhs.swap(rhs);
+        }
+    private:
+        tree_type tree_;
+
+        static std::pair<iterator, bool> Wrap(std::pair<tree_iterator, bool> result) {
+            return {iterator(result.first), result.second};
+        }
+    };
+}
@@ -1,60 +1,128 @@
 #pragma once
 #include <iostream>
-
-template<typename Key>
-class Node {
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// Node data whose value depends on the whole subtree (not just on the children's data being refreshed
+// by rotations) declares kAggregatesSubtree, so every ancestor of a changed position gets refreshed
+template<typename NodeData>
+concept SubtreeAggregateData = requires { requires NodeData::kAggregatesSubtree; };
+
+template<typename Key, typename... NodeData>
+class Node : public NodeData... {
 public:
+    static constexpr bool kAggregatesSubtree = (SubtreeAggregateData<NodeData> || ...);
+
     Key value;
     Node* left = nullptr;
     Node* right = nullptr;
     Node* parent = nullptr;
 
-    explicit Node(Key node_value) : value(node_value) {};
+    explicit Node(Key node_value) : value(std::move(node_value)) {};
+
+    // Builds the value from the arguments directly inside the node
+    template<typename... Args>
+    explicit Node(std::in_place_t, Args&&... args) : value(std::forward<Args>(args)...) {};
 
     ~Node() = default;
 
-    bool operator() (const Node<Key>& lhs, const Node<Key>& rhs) const {
+    bool operator() (const Node& lhs, const Node& rhs) const {
         return lhs.value < rhs.value;
     }
+
+    // Balancing/augmentation data is recomputed from the children after every structural change
+    void RefreshData() {
+        (NodeData::Refresh(*this), ...);
+    }
+
+    void CopyData(const Node& other) {
+        ((static_cast<NodeData&>(*this) = static_cast<const NodeData&>(other)), ...);
+    }
+
+    void SwapData(Node& other) {
+        (std::swap(static_cast<NodeData&>(*this), static_cast<NodeData&>(other)), ...);
+    }
+
+    // Returns a detached node to the state of a freshly constructed one before it is linked again
+    void ResetLinks() {
+        left = nullptr;
+        right = nullptr;
+        parent = nullptr;
+        ((static_cast<NodeData&>(*this) = NodeData{}), ...);
+    }
+};
+
+// Builds Node<Key, NodeData...> from the policies' node data, skipping policies that have none (void)
+template<typename NodeType, typename... NodeData>
+struct AppendNodeData {
+    using type = NodeType;
+};
+
+template<typename Key, typename... Accumulated, typename Data, typename... Rest>
+struct AppendNodeData<Node<Key, Accumulated...>, Data, Rest...> {
+    using type = typename AppendNodeData<std::conditional_t<std::is_void_v<Data>, Node<Key, Accumulated...>, Node<Key, Accumulated..., Data>>, Rest...>::type;
 };
 
-template<typename Key>
+namespace BST {
+    template<typename Key, typename TraversalTag, typename Comparator, typename Allocator, typename... Policies>
+    class BinarySearchTree;
+}
+
+// Owns a node detached from a tree, so it can be re-linked into a tree with the same node type
+// without reallocating it or copying its key
+template<typename Key, typename Allocator = std::allocator<Node<Key>>, typename NodeType = Node<Key>>
 class NodeWrapper {
 public:
     using value_type = Key;
-    using allocator_type = std::allocator<Node<value_type>>;
+    using allocator_type = Allocator;
 
     NodeWrapper() = default;
 
-    NodeWrapper(Node<value_type>*& node, allocator_type allocator) : value_(node->value), allocator_(allocator) {};
+    NodeWrapper(NodeType* node, allocator_type allocator) : node_(node), allocator_(allocator) {};
+
+    NodeWrapper(const NodeWrapper& other) = delete;
 
-    ~NodeWrapper() = default;
+    NodeWrapper(NodeWrapper&& other) noexcept : node_(std::exchange(other.node_, nullptr)), allocator_(std::move(other.allocator_)) {
+        other.allocator_.reset();
+    };
+
+    ~NodeWrapper() {
+        DestroyNode();
+    }
 
-    NodeWrapper& operator=(const NodeWrapper& rhs) {
-        value_ = rhs.value_;
-        allocator_ = rhs.allocator_;
+    NodeWrapper& operator=(const NodeWrapper& rhs) = delete;
+
+    NodeWrapper& operator=(NodeWrapper&& rhs) noexcept {
+        if (this != &rhs) {
+            DestroyNode();
+            node_ = std::exchange(rhs.node_, nullptr);
+            allocator_ = std::move(rhs.allocator_);
+            rhs.allocator_.reset();
+        }
 
         return *this;
     }
 
     [[nodiscard]] bool empty() const {
-        return value_ == value_type{};
+        return node_ == nullptr;
     }
 
     explicit operator bool() const {
-        return empty();
+        return !empty();
     }
 
     allocator_type get_allocator() const {
-        return allocator_;
+        return *allocator_;
     }
 
-    value_type value() const {
-        return value_;
+    value_type& value() const {
+        return node_->value;
     }
 
     void swap(NodeWrapper& rhs) {
-        std::swap(value_, rhs.value_);
+        std::swap(node_, rhs.node_);
         std::swap(allocator_, rhs.allocator_);
     }
 
@@ -62,6 +130,27 @@ public:
         lhs.swap(rhs);
     }
 private:
-    value_type value_;
-    allocator_type allocator_;
-};
\ No newline at end of file
+    using node_allocator_type = typename std::allocator_traits<allocator_type>::template rebind_alloc<NodeType>;
+    using node_allocator_traits = std::allocator_traits<node_allocator_type>;
+
+    NodeType* node_ = nullptr;
+    std::optional<allocator_type> allocator_;
+
+    template<typename, typename, typename, typename, typename...>
+    friend class BST::BinarySearchTree;
+
+    NodeType* Release() {
+        allocator_.reset();
+
+        return std::exchange(node_, nullptr);
+    }
+
+    void DestroyNode() {
+        if (node_ == nullptr) return;
+
+        node_allocator_type node_allocator(*allocator_);
+        node_allocator_traits::destroy(node_allocator, node_);
+        node_allocator_traits::deallocate(node_allocator, node_, 1);
+        node_ = nullptr;
+    }
+};
@@ -0,0 +1,986 @@
+#pragma once
+#include "bst.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace BST {
+    // Fork-join pool with one work queue per thread. invoke(left, right) queues right, runs left and then
+    // either takes right back or, when another thread stole it, helps with other queued work until it is
+    // done. The thread calling into the pool joins in, so a pool of n threads starts n - 1 workers
+    class TaskPool {
+        struct Task {
+            void (*run)(Task*) = nullptr;
+            std::exception_ptr error;
+            std::atomic<bool> done = false;
+        };
+
+        template<typename Function>
+        struct FunctionTask : Task {
+            Function& function;
+
+            explicit FunctionTask(Function& task_function) : function(task_function) {
+                this->run = &Run;
+            }
+
+            static void Run(Task* task) {
+                static_cast<FunctionTask*>(task)->function();
+            }
+        };
+
+        static constexpr std::size_t kQueueCapacity = 256;
+
+        // The owner pushes and pops at the bottom, thieves take the oldest (largest) task from the top
+        struct alignas(64) WorkQueue {
+            std::mutex mutex;
+            Task* tasks[kQueueCapacity] = {};
+            std::size_t top = 0;
+            std::size_t bottom = 0;
+
+            bool Push(Task* task) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (bottom - top == kQueueCapacity) return false;
+
+                tasks[bottom++ % kQueueCapacity] = task;
+
+                return true;
+            }
+
+            bool PopIf(Task* task) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (bottom == top || tasks[(bottom - 1) % kQueueCapacity] != task) return false;
+
+                --bottom;
+
+                return true;
+            }
+
+            Task* Steal() {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (bottom == top) return nullptr;
+
+                return tasks[top++ % kQueueCapacity];
+            }
+        };
+
+        struct Participant {
+            const TaskPool* pool;
+            std::size_t index;
+        };
+
+        static inline thread_local Participant current_{nullptr, 0};
+    public:
+        explicit TaskPool(std::size_t thread_count = std::thread::hardware_concurrency())
+                : thread_count_(std::max<std::size_t>(thread_count, 1)),
+                  queues_(std::make_unique<WorkQueue[]>(thread_count_)),
+                  workers_(std::make_unique<std::thread[]>(thread_count_)) {
+            for (std::size_t index = 1; index < thread_count_; ++index) {
+                workers_[index] = std::thread([this, index] {
+                    WorkerLoop(index);
+                });
+            }
+        }
+
+        TaskPool(const TaskPool&) = delete;
+
+        TaskPool& operator=(const TaskPool&) = delete;
+
+        ~TaskPool() {
+            {
+                std::lock_guard<std::mutex> lock(idle_mutex_);
+                stopping_ = true;
+            }
+            idle_cv_.notify_all();
+
+            for (std::size_t index = 1; index < thread_count_; ++index) {
+                workers_[index].join();
+            }
+        }
+
+        [[nodiscard]] std::size_t size() const {
+            return thread_count_;
+        }
+
+        // Runs both callables, possibly in parallel, and returns once both are done. An exception from
+        // either is rethrown here after the other one has finished
+        template<typename Left, typename Right>
+        void invoke(Left&& left, Right&& right) {
+            if (thread_count_ == 1) {
+                left();
+                right();
+                return;
+            }
+            if (current_.pool == this) {
+                Fork(current_.index, left, right);
+                return;
+            }
+
+            // Outside threads take turns as participant 0; workers only spin while someone is inside
+            std::lock_guard<std::mutex> external_lock(external_mutex_);
+            Participant outer = std::exchange(current_, Participant{this, 0});
+            SetActive(true);
+            try {
+                Fork(0, left, right);
+            } catch (...) {
+                SetActive(false);
+                current_ = outer;
+                throw;
+            }
+            SetActive(false);
+            current_ = outer;
+        }
+
+        // Calls function(i) for every i in [first, last), splitting the range in halves down to grain
+        template<typename Function>
+        void for_each_index(std::size_t first, std::size_t last, std::size_t grain, Function&& function) {
+            if (last - first <= std::max<std::size_t>(grain, 1)) {
+                for (std::size_t i = first; i < last; ++i) {
+                    function(i);
+                }
+                return;
+            }
+
+            std::size_t middle = first + (last - first) / 2;
+            invoke([&] { for_each_index(first, middle, grain, function); },
+                   [&] { for_each_index(middle, last, grain, function); });
+        }
+    private:
+        std::size_t thread_count_;
+        std::unique_ptr<WorkQueue[]> queues_;
+        std::unique_ptr<std::thread[]> workers_;
+
+        std::mutex external_mutex_;
+        std::mutex idle_mutex_;
+        std::condition_variable idle_cv_;
+        bool active_ = false;
+        bool stopping_ = false;
+
+        template<typename Left, typename Right>
+        void Fork(std::size_t index, Left& left, Right& right) {
+            FunctionTask<Right> right_task(right);
+            if (!queues_[index].Push(&right_task)) {
+                left();
+                right();
+                return;
+            }
+
+            std::exception_ptr left_error;
+            try {
+                left();
+            } catch (...) {
+                left_error = std::current_exception();
+            }
+
+            if (queues_[index].PopIf(&right_task)) {
+                if (left_error) std::rethrow_exception(left_error);
+                right();
+                return;
+            }
+
+            while (!right_task.done.load(std::memory_order_acquire)) {
+                if (Task* task = Steal(index)) {
+                    Execute(task);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+            if (left_error) std::rethrow_exception(left_error);
+            if (right_task.error) std::rethrow_exception(right_task.error);
+        }
+
+        static void Execute(Task* task) {
+            try {
+                task->run(task);
+            } catch (...) {
+                task->error = std::current_exception();
+            }
+            task->done.store(true, std::memory_order_release);
+        }
+
+        Task* Steal(std::size_t thief) {
+            for (std::size_t offset = 1; offset < thread_count_; ++offset) {
+                if (Task* task = queues_[(thief + offset) % thread_count_].Steal()) return task;
+            }
+
+            return nullptr;
+        }
+
+        void SetActive(bool active) {
+            {
+                std::lock_guard<std::mutex> lock(idle_mutex_);
+                active_ = active;
+            }
+            if (active) {
+                idle_cv_.notify_all();
+            }
+        }
+
+        void WorkerLoop(std::size_t index) {
+            current_ = Participant{this, index};
+            while (true) {
+                if (Task* task = Steal(index)) {
+                    Execute(task);
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> lock(idle_mutex_);
+                if (stopping_) return;
+                if (!active_) {
+                    idle_cv_.wait(lock, [this] { return stopping_ || active_; });
+                } else {
+                    lock.unlock();
+                    std::this_thread::yield();
+                }
+            }
+        }
+    };
+
+    namespace detail {
+        // Uninitialized key array from the tree's allocator. The elements are constructed in parallel at
+        // known offsets. If a copy throws, the writers destroy the slots they constructed before the
+        // exception gets here, so the buffer only frees the storage
+        template<typename T, typename Allocator>
+        class ParallelBuffer {
+            using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+            using allocator_traits = std::allocator_traits<allocator_type>;
+        public:
+            ParallelBuffer(std::size_t capacity, const Allocator& allocator)
+                    : allocator_(allocator), data_(allocator_traits::allocate(allocator_, std::max<std::size_t>(capacity, 1))),
+                      capacity_(std::max<std::size_t>(capacity, 1)) {};
+
+            ParallelBuffer(const ParallelBuffer&) = delete;
+
+            ParallelBuffer& operator=(const ParallelBuffer&) = delete;
+
+            ~ParallelBuffer() {
+                std::destroy_n(data_, constructed_);
+                allocator_traits::deallocate(allocator_, data_, capacity_);
+            }
+
+            T* data() const {
+                return data_;
+            }
+
+            // Called once all of [0, count) is constructed
+            void set_constructed(std::size_t count) {
+                constructed_ = count;
+            }
+
+            std::size_t size() const {
+                return constructed_;
+            }
+        private:
+            allocator_type allocator_;
+            T* data_;
+            std::size_t capacity_;
+            std::size_t constructed_ = 0;
+        };
+
+        // Parallel algorithms over BinarySearchTree internals. The top levels of a tree are split between
+        // tasks, every subtree below the cutoff depth is handled by one task with the usual parent-link
+        // walks. Subtrees are walked structurally, so keys come out in key order whatever the traversal
+        struct ParallelTreeAccess {
+            enum class SetOperation {
+                Union,
+                Intersection,
+                Difference,
+            };
+
+            // Enough subtrees to keep every thread busy when their sizes are uneven
+            static std::size_t CutoffDepth(const TaskPool& pool) {
+                return std::min<std::size_t>(std::bit_width(pool.size()) + 3, 16);
+            }
+
+            template<typename Tree, typename Function>
+            static void WalkInOrder(const Tree& tree, typename Tree::pointer subtree, Function& function) {
+                auto node = subtree;
+                while (!tree.IsEmptyChild(node->left)) {
+                    node = node->left;
+                }
+
+                while (true) {
+                    function(node);
+                    if (!tree.IsEmptyChild(node->right)) {
+                        node = node->right;
+                        while (!tree.IsEmptyChild(node->left)) {
+                            node = node->left;
+                        }
+                        continue;
+                    }
+
+                    while (node != subtree && node->parent->right == node) {
+                        node = node->parent;
+                    }
+                    if (node == subtree) return;
+                    node = node->parent;
+                }
+            }
+
+            template<typename Tree, typename Function>
+            static void ForEach(TaskPool& pool, const Tree& tree, typename Tree::pointer node, std::size_t depth,
+                                std::size_t cutoff, Function& function) {
+                if (tree.IsEmptyChild(node)) return;
+
+                if (depth == cutoff) {
+                    auto visit = [&function](typename Tree::pointer current) {
+                        function(std::as_const(current->value));
+                    };
+                    WalkInOrder(tree, node, visit);
+                    return;
+                }
+
+                pool.invoke([&] { ForEach(pool, tree, node->left, depth + 1, cutoff, function); },
+                            [&] {
+                                function(std::as_const(node->value));
+                                ForEach(pool, tree, node->right, depth + 1, cutoff, function);
+                            });
+            }
+
+            template<typename Tree, typename Function>
+            static void ForEachKey(TaskPool& pool, const Tree& tree, Function& function) {
+                ForEach(pool, tree, tree.head_root_, 0, CutoffDepth(pool), function);
+            }
+
+            // The in-order range [first, last) splits along the paths from both ends up to their lowest common
+            // ancestor into single nodes and whole subtrees; each subtree is handed to ForEach in turn
+            template<typename Tree, typename Function>
+            static void ForEachKeyInRange(TaskPool& pool, const Tree& tree, typename Tree::const_iterator first_iter,
+                                          typename Tree::const_iterator last_iter, Function& function) {
+                auto first = const_cast<typename Tree::pointer>(first_iter.node_ptr_);
+                auto last = const_cast<typename Tree::pointer>(last_iter.node_ptr_);
+                if (first == last) return;
+
+                std::size_t cutoff = CutoffDepth(pool);
+                auto visit_node = [&function](typename Tree::pointer node) {
+                    function(std::as_const(node->value));
+                };
+                auto visit_subtree = [&](typename Tree::pointer subtree) {
+                    ForEach(pool, tree, subtree, 0, cutoff, function);
+                };
+
+                typename Tree::pointer ancestor = nullptr;
+                if (last != tree.end_ptr_) {
+                    ancestor = LowestCommonAncestor(first, last);
+                }
+
+                // first and the nodes above it reached from a left child, each with its right subtree
+                if (first != ancestor) {
+                    visit_node(first);
+                    visit_subtree(first->right);
+                    for (auto node = first; node->parent != ancestor; node = node->parent) {
+                        if (node->parent->left == node) {
+                            visit_node(node->parent);
+                            visit_subtree(node->parent->right);
+                        }
+                    }
+                }
+                if (ancestor == nullptr) return;
+
+                // The ancestor, last's left subtree and the nodes above last reached from a right child, each
+                // with its left subtree
+                if (ancestor != last) {
+                    visit_node(ancestor);
+                    visit_subtree(last->left);
+                    for (auto node = last; node->parent != ancestor; node = node->parent) {
+                        if (node->parent->right == node) {
+                            visit_node(node->parent);
+                            visit_subtree(node->parent->left);
+                        }
+                    }
+                }
+            }
+
+            template<typename Pointer>
+            static Pointer LowestCommonAncestor(Pointer lhs, Pointer rhs) {
+                std::size_t lhs_depth = Depth(lhs);
+                std::size_t rhs_depth = Depth(rhs);
+                for (; lhs_depth > rhs_depth; --lhs_depth) {
+                    lhs = lhs->parent;
+                }
+                for (; rhs_depth > lhs_depth; --rhs_depth) {
+                    rhs = rhs->parent;
+                }
+                while (lhs != rhs) {
+                    lhs = lhs->parent;
+                    rhs = rhs->parent;
+                }
+
+                return lhs;
+            }
+
+            template<typename Pointer>
+            static std::size_t Depth(Pointer node) {
+                std::size_t depth = 0;
+                for (; node->parent != nullptr; node = node->parent) {
+                    ++depth;
+                }
+
+                return depth;
+            }
+
+            // sizes[i] is the size of the subtree at heap index i (root 1), filled down to the cutoff depth
+            template<typename Tree>
+            static std::size_t CountSubtrees(TaskPool& pool, const Tree& tree, typename Tree::pointer node, std::size_t index,
+                                             std::size_t depth, std::size_t cutoff, std::size_t* sizes) {
+                std::size_t count = 0;
+                if (tree.IsEmptyChild(node)) {
+                    count = 0;
+                } else if (depth == cutoff) {
+                    auto visit = [&count](typename Tree::pointer) {
+                        ++count;
+                    };
+                    WalkInOrder(tree, node, visit);
+                } else {
+                    std::size_t left_count = 0;
+                    std::size_t right_count = 0;
+                    pool.invoke([&] { left_count = CountSubtrees(pool, tree, node->left, 2 * index, depth + 1, cutoff, sizes); },
+                                [&] { right_count = CountSubtrees(pool, tree, node->right, 2 * index + 1, depth + 1, cutoff, sizes); });
+                    count = left_count + right_count + 1;
+                }
+                sizes[index] = count;
+
+                return count;
+            }
+
+            template<typename Tree, typename Key>
+            static void Flatten(TaskPool& pool, const Tree& tree, typename Tree::pointer node, std::size_t index,
+                                std::size_t depth, std::size_t cutoff, const std::size_t* sizes, Key* out) {
+                if (tree.IsEmptyChild(node)) return;
+
+                if (depth == cutoff) {
+                    std::size_t constructed = 0;
+                    auto visit = [out, &constructed](typename Tree::pointer current) {
+                        std::construct_at(out + constructed, current->value);
+                        ++constructed;
+                    };
+                    try {
+                        WalkInOrder(tree, node, visit);
+                    } catch (...) {
+                        std::destroy_n(out, constructed);
+                        throw;
+                    }
+                    return;
+                }
+
+                // A half that throws has destroyed its own slots, the halves that finished are destroyed here
+                std::size_t left_count = sizes[2 * index];
+                bool left_done = false;
+                bool node_done = false;
+                bool right_done = false;
+                try {
+                    pool.invoke([&] {
+                                    Flatten(pool, tree, node->left, 2 * index, depth + 1, cutoff, sizes, out);
+                                    left_done = true;
+                                },
+                                [&] {
+                                    std::construct_at(out + left_count, node->value);
+                                    node_done = true;
+                                    Flatten(pool, tree, node->right, 2 * index + 1, depth + 1, cutoff, sizes, out + left_count + 1);
+                                    right_done = true;
+                                });
+                } catch (...) {
+                    if (left_done) {
+                        std::destroy_n(out, left_count);
+                    }
+                    if (node_done) {
+                        std::destroy_at(out + left_count);
+                    }
+                    if (right_done) {
+                        std::destroy_n(out + left_count + 1, sizes[2 * index + 1]);
+                    }
+                    throw;
+                }
+            }
+
+            template<typename Tree>
+            static void ToSortedBuffer(TaskPool& pool, const Tree& tree,
+                                       ParallelBuffer<typename Tree::key_type, typename Tree::allocator_type>& buffer) {
+                using size_allocator_type = typename std::allocator_traits<typename Tree::allocator_type>::template rebind_alloc<std::size_t>;
+                using size_allocator_traits = std::allocator_traits<size_allocator_type>;
+
+                std::size_t cutoff = CutoffDepth(pool);
+                std::size_t sizes_length = std::size_t{2} << cutoff;
+                size_allocator_type size_allocator(tree.get_allocator());
+                std::size_t* sizes = size_allocator_traits::allocate(size_allocator, sizes_length);
+                std::fill_n(sizes, sizes_length, 0);
+
+                try {
+                    CountSubtrees(pool, tree, tree.head_root_, 1, 0, cutoff, sizes);
+                    Flatten(pool, tree, tree.head_root_, 1, 0, cutoff, sizes, buffer.data());
+                } catch (...) {
+                    size_allocator_traits::deallocate(size_allocator, sizes, sizes_length);
+                    throw;
+                }
+                buffer.set_constructed(tree.size());
+
+                size_allocator_traits::deallocate(size_allocator, sizes, sizes_length);
+            }
+
+            template<typename Tree>
+            static typename Tree::pointer CopySubtree(Tree& copy, const Tree& tree, typename Tree::pointer other_node) {
+                auto copy_root = copy.AllocateNode(other_node->value);
+                copy_root->CopyData(*other_node);
+
+                auto copy_node = copy_root;
+                auto other_root = other_node;
+                try {
+                    while (true) {
+                        if (!tree.IsEmptyChild(other_node->left) && copy_node->left == nullptr) {
+                            copy_node->left = copy.AllocateNode(other_node->left->value);
+                            copy_node->left->CopyData(*other_node->left);
+                            copy_node->left->parent = copy_node;
+                            other_node = other_node->left;
+                            copy_node = copy_node->left;
+                        } else if (!tree.IsEmptyChild(other_node->right) && copy_node->right == nullptr) {
+                            copy_node->right = copy.AllocateNode(other_node->right->value);
+                            copy_node->right->CopyData(*other_node->right);
+                            copy_node->right->parent = copy_node;
+                            other_node = other_node->right;
+                            copy_node = copy_node->right;
+                        } else if (other_node == other_root) {
+                            break;
+                        } else {
+                            other_node = other_node->parent;
+                            copy_node = copy_node->parent;
+                        }
+                    }
+                } catch (...) {
+                    copy.DeallocateSubtree(copy_root);
+                    throw;
+                }
+
+                return copy_root;
+            }
+
+            template<typename Tree>
+            static typename Tree::pointer Copy(TaskPool& pool, Tree& copy, const Tree& tree, typename Tree::pointer other_node,
+                                               std::size_t depth, std::size_t cutoff) {
+                if (tree.IsEmptyChild(other_node)) return nullptr;
+                if (depth == cutoff) return CopySubtree(copy, tree, other_node);
+
+                // invoke returns only after both halves are done, and a half that throws has freed its own nodes
+                auto copy_node = copy.AllocateNode(other_node->value);
+                copy_node->CopyData(*other_node);
+                try {
+                    pool.invoke([&] { copy_node->left = Copy(pool, copy, tree, other_node->left, depth + 1, cutoff); },
+                                [&] { copy_node->right = Copy(pool, copy, tree, other_node->right, depth + 1, cutoff); });
+                } catch (...) {
+                    LinkChildren(copy_node);
+                    copy.DeallocateSubtree(copy_node);
+                    throw;
+                }
+                LinkChildren(copy_node);
+
+                return copy_node;
+            }
+
+            // Same shape and colouring as BinarySearchTree::BuildBalanced, built from a random-access range
+            template<typename Tree, typename RandomIt>
+            static typename Tree::pointer Build(TaskPool& pool, Tree& tree, RandomIt keys, std::size_t count,
+                                                std::size_t depth, std::size_t complete_levels, std::size_t cutoff) {
+                if (count == 0) return nullptr;
+
+                std::size_t left_count = (count - 1) / 2;
+                auto new_node = tree.AllocateNode(keys[left_count]);
+                auto build_left = [&] {
+                    new_node->left = Build(pool, tree, keys, left_count, depth + 1, complete_levels, cutoff);
+                };
+                auto build_right = [&] {
+                    new_node->right = Build(pool, tree, keys + left_count + 1, count - 1 - left_count, depth + 1, complete_levels, cutoff);
+                };
+                try {
+                    if (depth < cutoff) {
+                        pool.invoke(build_left, build_right);
+                    } else {
+                        build_left();
+                        build_right();
+                    }
+                } catch (...) {
+                    LinkChildren(new_node);
+                    tree.DeallocateSubtree(new_node);
+                    throw;
+                }
+                LinkChildren(new_node);
+
+                Tree::balancing_policy::MarkBalancedNode(new_node, depth, complete_levels);
+                new_node->RefreshData();
+
+                return new_node;
+            }
+
+            template<typename Pointer>
+            static void LinkChildren(Pointer node) {
+                if (node->left != nullptr) {
+                    node->left->parent = node;
+                }
+                if (node->right != nullptr) {
+                    node->right->parent = node;
+                }
+            }
+
+            // Hands a plain tree (no sentinel, root without parent) to an empty tree and wires it up
+            template<typename Tree>
+            static void Adopt(Tree& tree, typename Tree::pointer root, std::size_t count) {
+                tree.head_root_ = root;
+                if (root != nullptr) {
+                    root->parent = nullptr;
+                }
+                Tree::balancing_policy::NormalizeRoot(root);
+                tree.tree_size_ = count;
+                tree.statistics_.RecordAllocations(count);
+                tree.RefreshMinAndMax();
+                tree.UpdateBeginAndEnd(tree.tag_);
+            }
+
+            template<typename Tree>
+            static Tree CopyTree(TaskPool& pool, const Tree& tree) {
+                Tree copy;
+                copy.comparator_ = tree.comparator_;
+                Adopt(copy, Copy(pool, copy, tree, tree.head_root_, 0, CutoffDepth(pool)), tree.size());
+
+                return copy;
+            }
+
+            template<typename Tree, typename RandomIt>
+            static Tree BuildFromSorted(TaskPool& pool, RandomIt keys, std::size_t count, const typename Tree::key_compare& comparator) {
+                Tree tree;
+                tree.comparator_ = comparator;
+                std::size_t complete_levels = std::bit_width(count + 1) - 1;
+                Adopt(tree, Build(pool, tree, keys, count, 0, complete_levels, CutoffDepth(pool)), count);
+
+                return tree;
+            }
+
+            // Both inputs sorted: cut them at evenly spaced keys of the larger one into independent chunks,
+            // size every chunk's output in parallel, then write the chunks at their prefix offsets
+            template<typename Key, typename Comparator, typename Allocator>
+            static std::size_t Combine(TaskPool& pool, SetOperation operation, const Key* lhs, std::size_t lhs_size,
+                                       const Key* rhs, std::size_t rhs_size, const Comparator& comparator, Key* out,
+                                       const Allocator& allocator) {
+                using size_allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<std::size_t>;
+                using size_allocator_traits = std::allocator_traits<size_allocator_type>;
+
+                const Key* pivots = (lhs_size >= rhs_size) ? lhs : rhs;
+                std::size_t pivot_range = std::max(lhs_size, rhs_size);
+                std::size_t chunks = std::min<std::size_t>(pivot_range, 8 * pool.size()) + 1;
+
+                // bounds[3 * c .. 3 * c + 2] = lhs end, rhs end and output offset of chunk c, followed by the
+                // number of keys each chunk has constructed so far
+                size_allocator_type size_allocator(allocator);
+                std::size_t bounds_length = 3 * (chunks + 1) + chunks;
+                std::size_t* bounds = size_allocator_traits::allocate(size_allocator, bounds_length);
+                std::size_t* constructed = bounds + 3 * (chunks + 1);
+                std::fill_n(constructed, chunks, 0);
+                bounds[0] = 0;
+                bounds[1] = 0;
+                for (std::size_t chunk = 1; chunk < chunks; ++chunk) {
+                    const Key& pivot = pivots[chunk * pivot_range / chunks];
+                    bounds[3 * chunk] = std::lower_bound(lhs, lhs + lhs_size, pivot, comparator) - lhs;
+                    bounds[3 * chunk + 1] = std::lower_bound(rhs, rhs + rhs_size, pivot, comparator) - rhs;
+                }
+                bounds[3 * chunks] = lhs_size;
+                bounds[3 * chunks + 1] = rhs_size;
+
+                pool.for_each_index(0, chunks, 1, [&](std::size_t chunk) {
+                    bounds[3 * chunk + 5] = Apply(operation, lhs + bounds[3 * chunk], lhs + bounds[3 * chunk + 3],
+                                                  rhs + bounds[3 * chunk + 1], rhs + bounds[3 * chunk + 4],
+                                                  comparator, CountingOutput<Key>{});
+                });
+
+                bounds[2] = 0;
+                for (std::size_t chunk = 1; chunk <= chunks; ++chunk) {
+                    bounds[3 * chunk + 2] += bounds[3 * chunk - 1];
+                }
+
+                // for_each_index returns only after every started chunk is done, so the counts are final here
+                try {
+                    pool.for_each_index(0, chunks, 1, [&](std::size_t chunk) {
+                        Apply(operation, lhs + bounds[3 * chunk], lhs + bounds[3 * chunk + 3], rhs + bounds[3 * chunk + 1],
+                              rhs + bounds[3 * chunk + 4], comparator, ConstructingOutput<Key>{out + bounds[3 * chunk + 2], constructed + chunk});
+                    });
+                } catch (...) {
+                    for (std::size_t chunk = 0; chunk < chunks; ++chunk) {
+                        std::destroy_n(out + bounds[3 * chunk + 2], constructed[chunk]);
+                    }
+                    size_allocator_traits::deallocate(size_allocator, bounds, bounds_length);
+                    throw;
+                }
+
+                std::size_t total = bounds[3 * chunks + 2];
+                size_allocator_traits::deallocate(size_allocator, bounds, bounds_length);
+
+                return total;
+            }
+
+            template<typename Key>
+            struct CountingOutput {
+                std::size_t count = 0;
+
+                void operator()(const Key&) {
+                    ++count;
+                }
+
+                std::size_t result() const {
+                    return count;
+                }
+            };
+
+            // The count lives outside the output, so it is still there when a copy throws
+            template<typename Key>
+            struct ConstructingOutput {
+                Key* out;
+                std::size_t* count;
+
+                void operator()(const Key& key_value) {
+                    std::construct_at(out + *count, key_value);
+                    ++*count;
+                }
+
+                std::size_t result() const {
+                    return *count;
+                }
+            };
+
+            template<typename Key, typename Comparator, typename Output>
+            static std::size_t Apply(SetOperation operation, const Key* lhs, const Key* lhs_end, const Key* rhs,
+                                     const Key* rhs_end, const Comparator& comparator, Output output) {
+                while (lhs != lhs_end && rhs != rhs_end) {
+                    if (comparator(*lhs, *rhs)) {
+                        if (operation != SetOperation::Intersection) {
+                            output(*lhs);
+                        }
+                        ++lhs;
+                    } else if (comparator(*rhs, *lhs)) {
+                        if (operation == SetOperation::Union) {
+                            output(*rhs);
+                        }
+                        ++rhs;
+                    } else {
+                        if (operation != SetOperation::Difference) {
+                            output(*lhs);
+                        }
+                        ++lhs;
+                        ++rhs;
+                    }
+                }
+                if (operation != SetOperation::Intersection) {
+                    for (; lhs != lhs_end; ++lhs) {
+                        output(*lhs);
+                    }
+                }
+                if (operation == SetOperation::Union) {
+                    for (; rhs != rhs_end; ++rhs) {
+                        output(*rhs);
+                    }
+                }
+
+                return output.result();
+            }
+
+            // Nodes and subtrees dropped by a join-based operation, chained through the parent links of their
+            // roots. Every task keeps its own list and the lists are spliced when the tasks join
+            template<typename Pointer>
+            struct DiscardedNodes {
+                Pointer head = nullptr;
+                Pointer tail = nullptr;
+
+                void add(Pointer subtree) {
+                    if (subtree == nullptr) return;
+
+                    subtree->parent = head;
+                    if (head == nullptr) {
+                        tail = subtree;
+                    }
+                    head = subtree;
+                }
+
+                void splice(DiscardedNodes other) {
+                    if (other.head == nullptr) return;
+
+                    other.tail->parent = head;
+                    if (head == nullptr) {
+                        tail = other.tail;
+                    }
+                    head = other.head;
+                }
+            };
+
+            // Splits rhs at the key of lhs's root, solves both sides as independent tasks and joins the results
+            // below the root when it is kept. Only nodes are relinked and nothing is freed, so the tasks share
+            // no tree state; the comparisons bypass the statistics counters for the same reason
+            template<typename Tree>
+            static typename Tree::pointer JoinOperation(TaskPool& pool, Tree& result, SetOperation operation, typename Tree::pointer lhs,
+                                                        typename Tree::pointer rhs, std::size_t depth, std::size_t cutoff,
+                                                        DiscardedNodes<typename Tree::pointer>& discarded) {
+                if (lhs == nullptr || rhs == nullptr) {
+                    if (operation == SetOperation::Union) return (lhs == nullptr) ? rhs : lhs;
+
+                    discarded.add(rhs);
+                    if (operation == SetOperation::Difference) return lhs;
+
+                    discarded.add(lhs);
+                    return nullptr;
+                }
+
+                const auto& comparator = result.comparator_;
+                auto less = [&comparator](const auto& lhs_key, const auto& rhs_key) { return comparator(lhs_key, rhs_key); };
+                auto lhs_left = Tree::Detach(lhs->left);
+                auto lhs_right = Tree::Detach(lhs->right);
+                auto pieces = Tree::SplitWith(rhs, lhs->value, less);
+                lhs->left = nullptr;
+                lhs->right = nullptr;
+
+                typename Tree::pointer left = nullptr;
+                typename Tree::pointer right = nullptr;
+                DiscardedNodes<typename Tree::pointer> right_discarded;
+                auto solve_left = [&] {
+                    left = JoinOperation(pool, result, operation, lhs_left, pieces.left, depth + 1, cutoff, discarded);
+                };
+                auto solve_right = [&] {
+                    right = JoinOperation(pool, result, operation, lhs_right, pieces.right, depth + 1, cutoff, right_discarded);
+                };
+                if (depth < cutoff) {
+                    pool.invoke(solve_left, solve_right);
+                } else {
+                    solve_left();
+                    solve_right();
+                }
+                discarded.splice(right_discarded);
+
+                bool found = pieces.equal != nullptr;
+                discarded.add(pieces.equal);
+                if (operation == SetOperation::Union || found == (operation == SetOperation::Intersection)) {
+                    return Tree::balancing_policy::Join(left, lhs, right);
+                }
+                discarded.add(lhs);
+
+                return result.JoinTrees(left, right);
+            }
+
+            // Balanced trees with unique keys: both are copied into the result's nodes in parallel and
+            // combined by split and join, which takes O(m log(n / m + 1)) work for sizes m <= n. The
+            // dropped nodes are freed afterwards through the result, so its size and statistics stay exact
+            template<typename Tree>
+            static Tree JoinCombine(TaskPool& pool, SetOperation operation, const Tree& lhs, const Tree& rhs) {
+                Tree result;
+                result.comparator_ = lhs.comparator_;
+                std::size_t cutoff = CutoffDepth(pool);
+                typename Tree::pointer lhs_root = nullptr;
+                typename Tree::pointer rhs_root = nullptr;
+                try {
+                    pool.invoke([&] { lhs_root = Copy(pool, result, lhs, lhs.head_root_, 0, cutoff); },
+                                [&] { rhs_root = Copy(pool, result, rhs, rhs.head_root_, 0, cutoff); });
+                } catch (...) {
+                    result.DeallocateSubtree(lhs_root);
+                    result.DeallocateSubtree(rhs_root);
+                    throw;
+                }
+
+                DiscardedNodes<typename Tree::pointer> discarded;
+                auto root = JoinOperation(pool, result, operation, lhs_root, rhs_root, 0, cutoff, discarded);
+                Adopt(result, root, lhs.size() + rhs.size());
+
+                for (auto subtree = discarded.head; subtree != nullptr; ) {
+                    auto next_subtree = subtree->parent;
+                    subtree->parent = nullptr;
+                    result.DestroySubtree(subtree);
+                    subtree = next_subtree;
+                }
+
+                return result;
+            }
+
+            template<typename Tree>
+            static Tree SetCombine(TaskPool& pool, SetOperation operation, const Tree& lhs, const Tree& rhs) {
+                if constexpr (!std::is_same_v<typename Tree::balancing_policy, NoBalancing> && !Tree::kAllowsEquivalentKeys) {
+                    return JoinCombine(pool, operation, lhs, rhs);
+                }
+
+                using key_type = typename Tree::key_type;
+                using allocator_type = typename Tree::allocator_type;
+
+                ParallelBuffer<key_type, allocator_type> lhs_keys(lhs.size(), lhs.get_allocator());
+                ParallelBuffer<key_type, allocator_type> rhs_keys(rhs.size(), lhs.get_allocator());
+                pool.invoke([&] { ToSortedBuffer(pool, lhs, lhs_keys); },
+                            [&] { ToSortedBuffer(pool, rhs, rhs_keys); });
+
+                ParallelBuffer<key_type, allocator_type> result_keys(lhs.size() + rhs.size(), lhs.get_allocator());
+                std::size_t result_size = Combine(pool, operation, lhs_keys.data(), lhs_keys.size(), rhs_keys.data(),
+                                                  rhs_keys.size(), lhs.comparator_, result_keys.data(), lhs.get_allocator());
+                result_keys.set_constructed(result_size);
+
+                return BuildFromSorted<Tree>(pool, result_keys.data(), result_size, lhs.comparator_);
+            }
+        };
+    }
+
+    // Parallel bulk operations on BinarySearchTree. The work is split by subtree between the threads of
+    // the pool, so the allocator must be safe to call from several threads (std::allocator is, a
+    // SlabAllocator is not), and the trees must not be modified while an operation runs
+
+    // Same shape and node data as the copy constructor
+    template<typename Key, typename TraversalTag, typename Comparator, typename Allocator, typename... Policies>
+    BinarySearchTree<Key, TraversalTag, Comparator, Allocator, Policies...>
+    parallel_copy(TaskPool& pool, const BinarySearchTree<Key, TraversalTag, Comparator, Allocator, Policies...>& tree) {
+        return detail::ParallelTreeAccess::CopyTree(pool, tree);
+    }
+
+    // With a balancing policy and unique keys the set operations are fork-join over split and join on copies
+    // of the two trees. Otherwise they flatten both trees, combine the sorted keys in independent key-range
+    // chunks and build a perfectly balanced result
+    template<typename Key, typename TraversalTag, typename Comparator, typename Allocator, typename... Policies>
+    BinarySearchTree<Key, TraversalTag, Comparator, Allocator, Policies...>
+    parallel_union(TaskPool& pool, const BinarySearchTree<Key, TraversalTag, Comparator, Allocator, Policies...>& lhs,
+                   const BinarySearchTree<Key, TraversalTag, Comparator, Allocator, Policies...>& rhs) {
+        return detail::ParallelTreeAccess::SetCombine(pool, detail::ParallelTreeAccess::SetOperation::Union, lhs, rhs);
+    }
+
+    template<typename Key, typename TraversalTag, typename Comparator, typename Allocator, typename... Policies>
+    BinarySearchTree<Key, TraversalTag, Comparator, Allocator, Policies...>
+    parallel_intersection(TaskPool& pool, const BinarySearchTree<Key, TraversalTag, Comparator, Allocator, Policies...>& lhs,
+                          const BinarySearchTree<Key, TraversalTag, Comparator, Allocator, Policies...>& rhs) {
+        return detail::ParallelTreeAccess::SetCombine(pool, detail::ParallelTreeAccess::SetOperation::Intersection, lhs, rhs);
+    }
+
+    template<typename Key, typename TraversalTag, typename Comparator, typename Allocator, typename... Policies>
+    BinarySearchTree<Key, TraversalTag, Comparator, Allocator, Policies...>
+    parallel_difference(TaskPool& pool, const BinarySearchTree<Key, TraversalTag, Comparator, Allocator, Policies...>& lhs,
+                        const BinarySearchTree<Key, TraversalTag, Comparator, Allocator, Policies...>& rhs) {
+        return detail::ParallelTreeAccess::SetCombine(pool, detail::ParallelTreeAccess::SetOperation::Difference, lhs, rhs);
+    }
+
+    // Same shape and colouring as the sorted_unique constructor, the top levels are built by separate tasks.
+    // The caller guarantees strictly increasing keys (non-decreasing with EquivalentKeys)
+    template<typename Tree, LegacyRandomAccessIterator RandomIt>
+    Tree parallel_build(TaskPool& pool, sorted_unique_t tag, RandomIt first, RandomIt last,
+                        const typename Tree::key_compare& comparator = typename Tree::key_compare()) {
+        return detail::ParallelTreeAccess::BuildFromSorted<Tree>(pool, first, static_cast<std::size_t>(last - first), comparator);
+    }
+
+    // Calls function(key) for every key, concurrently from the pool's threads. Each task walks one
+    // contiguous in-order range of keys (a subtree), so function must be safe to call concurrently
+    template<typename Key, typename TraversalTag, typename Comparator, typename Allocator, typename... Policies, typename Function>
+    void parallel_for_each(TaskPool& pool, const BinarySearchTree<Key, TraversalTag, Comparator, Allocator, Policies...>& tree,
+                           Function function) {
+        detail::ParallelTreeAccess::ForEachKey(pool, tree, function);
+    }
+
+    // Calls function(key) for every key in [first, last) of an in-order tree. The range costs O(height)
+    // to split into subtrees, which are then walked as above
+    template<typename Key, typename Comparator, typename Allocator, typename... Policies, typename Function>
+    void parallel_for_each(TaskPool& pool, const BinarySearchTree<Key, InOrderTraversal, Comparator, Allocator, Policies...>& tree,
+                           typename BinarySearchTree<Key, InOrderTraversal, Comparator, Allocator, Policies...>::const_iterator first,
+                           typename BinarySearchTree<Key, InOrderTraversal, Comparator, Allocator, Policies...>::const_iterator last,
+                           Function function) {
+        detail::ParallelTreeAccess::ForEachKeyInRange(pool, tree, first, last, function);
+    }
+}
@@ -0,0 +1,375 @@
+#pragma once
+#include "bst.h"
+#include "parallel.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace BST {
+    // Binary snapshot of a set of trivially copyable keys: a 64-byte header followed by the keys in key
+    // order, exactly as they lie in memory. The layout is only portable between builds that agree on the
+    // key type, its size and the byte order, which the header records and the readers check
+    struct SnapshotHeader {
+        static constexpr std::uint64_t kMagic = 0x50414e5354534231; // "1BSTSNAP" read little-endian
+        static constexpr std::uint32_t kVersion = 1;
+        static constexpr std::uint32_t kByteOrderMark = 0x01020304;
+
+        std::uint64_t magic = kMagic;
+        std::uint32_t version = kVersion;
+        std::uint32_t byte_order = kByteOrderMark;
+        std::uint64_t key_size = 0;
+        std::uint64_t key_alignment = 0;
+        std::uint64_t count = 0;
+        std::uint64_t checksum = 0; // over the key bytes
+        std::uint64_t reserved[2] = {};
+    };
+
+    static_assert(sizeof(SnapshotHeader) == 64 && std::is_trivially_copyable_v<SnapshotHeader>);
+
+    namespace detail {
+        // Word-at-a-time multiply-rotate hash. It only has to catch truncated and corrupted files, and it
+        // keeps up with the disk when a multi-gigabyte snapshot is verified on load. Data fed in several
+        // parts must be split at multiples of 8 bytes
+        class SnapshotChecksum {
+        public:
+            void update(const std::byte* data, std::size_t size) {
+                std::size_t offset = 0;
+                for (; offset + 8 <= size; offset += 8) {
+                    std::uint64_t word;
+                    std::memcpy(&word, data + offset, 8);
+                    Mix(word);
+                }
+                if (offset < size) {
+                    std::uint64_t word = 0;
+                    std::memcpy(&word, data + offset, size - offset);
+                    Mix(word ^ (size - offset));
+                }
+                length_ += size;
+            }
+
+            [[nodiscard]] std::uint64_t value() const {
+                std::uint64_t result = state_ ^ length_;
+                result ^= result >> 33;
+                result *= 0xff51afd7ed558ccdULL;
+                result ^= result >> 33;
+
+                return result;
+            }
+        private:
+            std::uint64_t state_ = 0x9e3779b97f4a7c15ULL;
+            std::uint64_t length_ = 0;
+
+            void Mix(std::uint64_t word) {
+                state_ = std::rotl((state_ ^ word) * 0x87c37b91114253d5ULL, 31) * 0x4cf5ad432745937fULL;
+            }
+        };
+
+        // Flushes a written file or a directory entry to the disk, so a rename is never persisted ahead of
+        // the data it points to
+        inline void SyncToDisk(const std::filesystem::path& path, int flags) {
+            int descriptor = ::open(path.c_str(), flags | O_CLOEXEC);
+            if (descriptor < 0) throw std::runtime_error("Cannot open " + path.string() + " for syncing");
+
+            int result = ::fsync(descriptor);
+            ::close(descriptor);
+            if (result != 0) throw std::runtime_error("Cannot sync " + path.string());
+        }
+
+        struct SnapshotFileAccess {
+            // Key order regardless of the traversal tag, without sorting
+            template<typename Tree, typename Function>
+            static void ForEachKey(const Tree& tree, Function&& function) {
+                for (auto node = tree.min_ptr_; node != nullptr; node = tree.NextInKeyOrder(node)) {
+                    function(std::as_const(node->value));
+                }
+            }
+        };
+    }
+
+    // Read-only view of a snapshot file mapped into memory. Nothing is read or copied up front: lookups
+    // binary-search the mapped keys, so only the pages they touch are faulted in. Opening checks the
+    // header and the file size; verify() checks the key bytes against the checksum
+    template<typename Key, typename Comparator = std::less<Key>>
+    class MappedSnapshot {
+        static_assert(std::is_trivially_copyable_v<Key>, "Snapshots store the key bytes as they are");
+        static_assert(alignof(Key) <= sizeof(SnapshotHeader), "Keys follow the 64-byte header");
+    public:
+        using key_type = Key;
+        using value_type = Key;
+        using key_compare = Comparator;
+        using value_compare = Comparator;
+        using size_type = std::size_t;
+        using difference_type = std::ptrdiff_t;
+        using reference = const value_type&;
+        using const_reference = const value_type&;
+        using iterator = const value_type*;
+        using const_iterator = const value_type*;
+
+        explicit MappedSnapshot(const std::filesystem::path& path, const key_compare& comparator = key_compare())
+                : comparator_(comparator) {
+            int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (descriptor < 0) throw std::runtime_error("Cannot open snapshot " + path.string());
+
+            struct stat file_status{};
+            if (::fstat(descriptor, &file_status) != 0 || static_cast<std::size_t>(file_status.st_size) < sizeof(SnapshotHeader)) {
+                ::close(descriptor);
+                throw std::runtime_error("Truncated snapshot " + path.string());
+            }
+
+            mapping_size_ = static_cast<std::size_t>(file_status.st_size);
+            void* mapping = ::mmap(nullptr, mapping_size_, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            ::close(descriptor);
+            if (mapping == MAP_FAILED) throw std::runtime_error("Cannot map snapshot " + path.string());
+            mapping_ = static_cast<const std::byte*>(mapping);
+
+            SnapshotHeader header;
+            std::memcpy(&header, mapping_, sizeof(header));
+            if (header.magic != SnapshotHeader::kMagic || header.version != SnapshotHeader::kVersion
+                || header.byte_order != SnapshotHeader::kByteOrderMark || header.key_size != sizeof(Key)
+                || header.key_alignment != alignof(Key)
+                || header.count > (mapping_size_ - sizeof(SnapshotHeader)) / sizeof(Key)
+                || mapping_size_ != sizeof(SnapshotHeader) + header.count * sizeof(Key)) {
+                Unmap();
+                throw std::runtime_error("Incompatible snapshot " + path.string());
+            }
+
+            keys_ = reinterpret_cast<const Key*>(mapping_ + sizeof(SnapshotHeader));
+            size_ = header.count;
+            checksum_ = header.checksum;
+        }
+
+        MappedSnapshot(const MappedSnapshot&) = delete;
+
+        MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+        MappedSnapshot(MappedSnapshot&& other) noexcept
+                : mapping_(std::exchange(other.mapping_, nullptr)), mapping_size_(std::exchange(other.mapping_size_, 0)),
+                  keys_(std::exchange(other.keys_, nullptr)), size_(std::exchange(other.size_, 0)),
+                  checksum_(other.checksum_), comparator_(std::move(other.comparator_)) {};
+
+        MappedSnapshot& operator=(MappedSnapshot&& rhs) noexcept {
+            std::swap(mapping_, rhs.mapping_);
+            std::swap(mapping_size_, rhs.mapping_size_);
+            std::swap(keys_, rhs.keys_);
+            std::swap(size_, rhs.size_);
+            std::swap(checksum_, rhs.checksum_);
+            std::swap(comparator_, rhs.comparator_);
+
+            return *this;
+        }
+
+        ~MappedSnapshot() {
+            Unmap();
+        }
+
+        iterator begin() const {
+            return keys_;
+        }
+
+        iterator end() const {
+            return keys_ + size_;
+        }
+
+        [[nodiscard]] size_type size() const {
+            return size_;
+        }
+
+        [[nodiscard]] bool empty() const {
+            return size_ == 0;
+        }
+
+        [[nodiscard]] key_compare key_comp() const {
+            return comparator_;
+        }
+
+        iterator find(const key_type& key_value) const {
+            return Find(key_value);
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        iterator find(const K& key_value) const {
+            return Find(key_value);
+        }
+
+        size_type count(const key_type& key_value) const {
+            return Find(key_value) != end();
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        size_type count(const K& key_value) const {
+            return Find(key_value) != end();
+        }
+
+        bool contains(const key_type& key_value) const {
+            return count(key_value);
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        bool contains(const K& key_value) const {
+            return count(key_value);
+        }
+
+        iterator lower_bound(const key_type& key_value) const {
+            return std::lower_bound(begin(), end(), key_value, comparator_);
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        iterator lower_bound(const K& key_value) const {
+            return std::lower_bound(begin(), end(), key_value, comparator_);
+        }
+
+        iterator upper_bound(const key_type& key_value) const {
+            return std::upper_bound(begin(), end(), key_value, comparator_);
+        }
+
+        template<typename K> requires TransparentComparator<key_compare>
+        iterator upper_bound(const K& key_value) const {
+            return std::upper_bound(begin(), end(), key_value, comparator_);
+        }
+
+        // Reads every key once
+        [[nodiscard]] bool verify() const {
+            detail::SnapshotChecksum checksum;
+            checksum.update(reinterpret_cast<const std::byte*>(keys_), size_ * sizeof(Key));
+
+            return checksum.value() == checksum_;
+        }
+
+        // Asks the kernel to read the whole file ahead, for callers about to scan it
+        void prefetch() const {
+            if (mapping_ != nullptr) {
+                ::madvise(const_cast<std::byte*>(mapping_), mapping_size_, MADV_SEQUENTIAL);
+                ::madvise(const_cast<std::byte*>(mapping_), mapping_size_, MADV_WILLNEED);
+            }
+        }
+    private:
+        const std::byte* mapping_ = nullptr;
+        size_type mapping_size_ = 0;
+        const Key* keys_ = nullptr;
+        size_type size_ = 0;
+        std::uint64_t checksum_ = 0;
+        key_compare comparator_;
+
+        template<typename K>
+        iterator Find(const K& key_value) const {
+            iterator bound = std::lower_bound(begin(), end(), key_value, comparator_);
+            if (bound == end() || comparator_(key_value, *bound)) return end();
+
+            return bound;
+        }
+
+        void Unmap() {
+            if (mapping_ != nullptr) {
+                ::munmap(const_cast<std::byte*>(mapping_), mapping_size_);
+                mapping_ = nullptr;
+            }
+        }
+    };
+
+    // Writes the keys in key order to a temporary file next to path and renames it over path, so readers
+    // never see a partly written snapshot. The file is synced before the rename and the directory after it,
+    // so after a crash path holds either the old or the complete new snapshot
+    template<typename Key, typename TraversalTag, typename Comparator, typename Allocator, typename... Policies>
+    void save(const BinarySearchTree<Key, TraversalTag, Comparator, Allocator, Policies...>& tree, const std::filesystem::path& path) {
+        static_assert(std::is_trivially_copyable_v<Key>, "Snapshots store the key bytes as they are");
+
+        // A whole number of 8-key groups, so every chunk but the last is a multiple of 8 bytes
+        constexpr std::size_t kChunkKeys = 8 * std::max<std::size_t>(1, 8192 / sizeof(Key));
+
+        std::filesystem::path temporary_path = path;
+        temporary_path += ".tmp";
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!file) throw std::runtime_error("Cannot create snapshot " + temporary_path.string());
+
+        SnapshotHeader header;
+        header.key_size = sizeof(Key);
+        header.key_alignment = alignof(Key);
+        header.count = tree.size();
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        auto chunk = std::make_unique_for_overwrite<std::byte[]>(kChunkKeys * sizeof(Key));
+        std::size_t chunk_keys = 0;
+        detail::SnapshotChecksum checksum;
+        auto flush = [&]() {
+            checksum.update(chunk.get(), chunk_keys * sizeof(Key));
+            file.write(reinterpret_cast<const char*>(chunk.get()), static_cast<std::streamsize>(chunk_keys * sizeof(Key)));
+            chunk_keys = 0;
+        };
+        detail::SnapshotFileAccess::ForEachKey(tree, [&](const Key& key_value) {
+            std::memcpy(chunk.get() + chunk_keys * sizeof(Key), &key_value, sizeof(Key));
+            if (++chunk_keys == kChunkKeys) {
+                flush();
+            }
+        });
+        flush();
+
+        header.checksum = checksum.value();
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.close();
+        if (!file) {
+            std::filesystem::remove(temporary_path);
+            throw std::runtime_error("Cannot write snapshot " + temporary_path.string());
+        }
+
+        try {
+            detail::SyncToDisk(temporary_path, O_WRONLY);
+        } catch (...) {
+            std::filesystem::remove(temporary_path);
+            throw;
+        }
+        std::filesystem::rename(temporary_path, path);
+
+        std::filesystem::path directory = path.parent_path();
+        detail::SyncToDisk(directory.empty() ? std::filesystem::path(".") : directory, O_RDONLY | O_DIRECTORY);
+    }
+
+    namespace detail {
+        // The checksum is verified first, then the key order under Tree's comparator, as a snapshot saved
+        // with another comparator or with EquivalentKeys passes the checksum
+        template<typename Tree>
+        void CheckSnapshot(MappedSnapshot<typename Tree::key_type, typename Tree::key_compare>& snapshot,
+                           const std::filesystem::path& path) {
+            snapshot.prefetch();
+            if (!snapshot.verify()) throw std::runtime_error("Corrupted snapshot " + path.string());
+
+            typename Tree::key_compare comparator;
+            auto out_of_order = std::adjacent_find(snapshot.begin(), snapshot.end(), [&comparator](const auto& lhs, const auto& rhs) {
+                return Tree::kAllowsEquivalentKeys ? comparator(rhs, lhs) : !comparator(lhs, rhs);
+            });
+            if (out_of_order != snapshot.end()) throw std::runtime_error("Incompatible snapshot " + path.string());
+        }
+    }
+
+    // Rebuilds a tree from a snapshot in O(n): the mapped keys are already sorted, so they are linked
+    // straight into a balanced shape once the snapshot is checked. Only the keys are stored, so pre- and
+    // post-order trees come back in the balanced shape and iterate in a different order than when saved
+    template<typename Tree>
+    Tree load(const std::filesystem::path& path) {
+        MappedSnapshot<typename Tree::key_type, typename Tree::key_compare> snapshot(path);
+        detail::CheckSnapshot<Tree>(snapshot, path);
+
+        return Tree(sorted_unique, snapshot.begin(), snapshot.end());
+    }
+
+    // Same as above, with the top levels of the tree built by separate tasks of the pool
+    template<typename Tree>
+    Tree load(TaskPool& pool, const std::filesystem::path& path) {
+        MappedSnapshot<typename Tree::key_type, typename Tree::key_compare> snapshot(path);
+        detail::CheckSnapshot<Tree>(snapshot, path);
+
+        return parallel_build<Tree>(pool, sorted_unique, snapshot.begin(), snapshot.end());
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <type_traits>
+
+namespace BST {
+    // Picks the policy of the given category out of the tree's policy list, falls back to Default
+    template<typename Category, typename Default, typename... Policies>
+    struct SelectPolicy {
+        using type = Default;
+    };
+
+    template<typename Category, typename Default, typename Policy, typename... Policies>
+    struct SelectPolicy<Category, Default, Policy, Policies...> {
+        using type = std::conditional_t<std::is_same_v<typename Policy::policy_category, Category>,
+                Policy,
+                typename SelectPolicy<Category, Default, Policies...>::type>;
+    };
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+namespace BST {
+    // Fixed-size block pool: blocks are carved out of geometrically growing chunks, released blocks go to an
+    // intrusive free list and chunks are returned to the system all at once when the pool dies. Not thread-safe
+    class SlabPool {
+    public:
+        static constexpr std::size_t kFirstChunkBlocks = 64;
+        static constexpr std::size_t kMaxChunkBlocks = 1 << 16;
+
+        SlabPool() = default;
+
+        SlabPool(const SlabPool& other) = delete;
+
+        SlabPool& operator=(const SlabPool& rhs) = delete;
+
+        ~SlabPool() {
+            while (chunks_ != nullptr) {
+                ChunkHeader* previous_chunk = chunks_->previous;
+                ::operator delete(static_cast<void*>(chunks_), std::align_val_t{block_alignment_});
+                chunks_ = previous_chunk;
+            }
+        }
+
+        // Block size is fixed by the first allocation, later requests have to fit into it
+        [[nodiscard]] bool Fits(std::size_t size, std::size_t alignment) const {
+            return block_size_ == 0 || (size <= block_size_ && alignment <= block_alignment_);
+        }
+
+        void* Allocate(std::size_t size, std::size_t alignment) {
+            if (block_size_ == 0) {
+                block_alignment_ = std::max({alignment, alignof(FreeBlock), alignof(ChunkHeader)});
+                block_size_ = RoundUp(std::max(size, sizeof(FreeBlock)), block_alignment_);
+            }
+
+            if (free_list_ != nullptr) {
+                FreeBlock* block = free_list_;
+                free_list_ = block->next;
+
+                return block;
+            }
+
+            if (chunk_cursor_ == chunk_end_) AllocateChunk();
+
+            void* block = chunk_cursor_;
+            chunk_cursor_ += block_size_;
+
+            return block;
+        }
+
+        void Deallocate(void* block) {
+            free_list_ = ::new(block) FreeBlock{free_list_};
+        }
+    private:
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+
+        struct ChunkHeader {
+            ChunkHeader* previous;
+        };
+
+        ChunkHeader* chunks_ = nullptr;
+        FreeBlock* free_list_ = nullptr;
+        std::byte* chunk_cursor_ = nullptr;
+        std::byte* chunk_end_ = nullptr;
+        std::size_t next_chunk_blocks_ = kFirstChunkBlocks;
+        std::size_t block_size_ = 0;
+        std::size_t block_alignment_ = 0;
+
+        static std::size_t RoundUp(std::size_t size, std::size_t alignment) {
+            return (size + alignment - 1) / alignment * alignment;
+        }
+
+        void AllocateChunk() {
+            std::size_t header_size = RoundUp(sizeof(ChunkHeader), block_alignment_);
+            std::size_t chunk_size = header_size + next_chunk_blocks_ * block_size_;
+            auto* chunk = static_cast<std::byte*>(::operator new(chunk_size, std::align_val_t{block_alignment_}));
+
+            chunks_ = ::new(chunk) ChunkHeader{chunks_};
+            chunk_cursor_ = chunk + header_size;
+            chunk_end_ = chunk + chunk_size;
+            next_chunk_blocks_ = std::min(next_chunk_blocks_ * 2, kMaxChunkBlocks);
+        }
+    };
+
+    // Allocator for tree nodes backed by a SlabPool. Copies and rebinds share the pool, so a tree and every
+    // allocator obtained from it compare equal; the memory goes away with the last copy (i.e. with the tree)
+    template<typename T>
+    class SlabAllocator {
+    public:
+        using value_type = T;
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+        using is_always_equal = std::false_type;
+
+        SlabAllocator() : pool_(std::make_shared<SlabPool>()) {};
+
+        template<typename U>
+        SlabAllocator(const SlabAllocator<U>& other) noexcept : pool_(other.pool_) {};
+
+        T* allocate(std::size_t n) {
+            if (n != 1 || !pool_->Fits(sizeof(T), alignof(T))) {
+                return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{alignof(T)}));
+            }
+
+            return static_cast<T*>(pool_->Allocate(sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T* pointer, std::size_t n) {
+            if (n != 1 || !pool_->Fits(sizeof(T), alignof(T))) {
+                ::operator delete(static_cast<void*>(pointer), std::align_val_t{alignof(T)});
+                return;
+            }
+
+            pool_->Deallocate(pointer);
+        }
+
+        // True when every block of T came from the pool and no other allocator shares it, so destroying
+        // this allocator returns all of them to the system
+        [[nodiscard]] bool owns_all_blocks() const noexcept {
+            return pool_.use_count() == 1 && pool_->Fits(sizeof(T), alignof(T));
+        }
+
+        template<typename U>
+        bool operator==(const SlabAllocator<U>& rhs) const {
+            return pool_ == rhs.pool_;
+        }
+
+        template<typename U>
+        bool operator!=(const SlabAllocator<U>& rhs) const {
+            return !(operator==(rhs));
+        }
+    private:
+        std::shared_ptr<SlabPool> pool_;
+
+        template<typename U>
+        friend class SlabAllocator;
+    };
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "policy.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace BST {
+    struct StatisticsPolicyTag {};
+
+    enum class TreeOperation {
+        kSearch,
+        kInsert,
+        kErase
+    };
+
+    // Counters exported by stats(). A path is the number of nodes one descent visited; searches cover
+    // find, contains, count and the bounds, erases the lookup of the erased key. A hinted insert that fits
+    // its hint records the one or two neighbours it compared with
+    struct TreeStatistics {
+        static constexpr std::size_t kDepthBuckets = 64;
+
+        std::uint64_t comparisons = 0;
+        std::uint64_t searches = 0;
+        std::uint64_t search_visits = 0;
+        std::uint64_t inserts = 0;
+        std::uint64_t insert_visits = 0;
+        std::uint64_t erases = 0;
+        std::uint64_t erase_visits = 0;
+        std::uint64_t allocations = 0; // nodes, the sentinel included
+        std::uint64_t deallocations = 0;
+        std::uint64_t max_depth = 0; // longest path so far, a node inserted there sits one level deeper
+        std::uint64_t height = 0;    // measured when the snapshot is taken
+        // Bucket b counts the paths of 2^(b - 1) to 2^b - 1 nodes, bucket 0 the ones on an empty tree
+        std::uint64_t depth_histogram[kDepthBuckets] = {};
+    };
+
+    // The default: every hook is an empty inline function on an empty member, so the calls vanish
+    struct NoStatistics {
+        using policy_category = StatisticsPolicyTag;
+
+        struct recorder {
+            static constexpr bool kEnabled = false;
+
+            void RecordComparison() const {}
+
+            void RecordPath(TreeOperation, std::size_t) const {}
+
+            void RecordAllocations(std::size_t) const {}
+
+            void RecordDeallocation() const {}
+        };
+    };
+
+    // Counts comparator calls, descents by operation with their lengths, and node allocations. The
+    // counters are plain integers updated by const lookups too, so a tree read from several threads at
+    // once needs its own synchronization for them
+    struct CollectStatistics {
+        using policy_category = StatisticsPolicyTag;
+
+        struct recorder {
+            static constexpr bool kEnabled = true;
+
+            mutable TreeStatistics counters;
+
+            void RecordComparison() const {
+                ++counters.comparisons;
+            }
+
+            void RecordPath(TreeOperation operation, std::size_t depth) const {
+                switch (operation) {
+                    case TreeOperation::kSearch:
+                        ++counters.searches;
+                        counters.search_visits += depth;
+                        break;
+                    case TreeOperation::kInsert:
+                        ++counters.inserts;
+                        counters.insert_visits += depth;
+                        break;
+                    case TreeOperation::kErase:
+                        ++counters.erases;
+                        counters.erase_visits += depth;
+                        break;
+                }
+                counters.max_depth = std::max<std::uint64_t>(counters.max_depth, depth);
+                ++counters.depth_histogram[std::min<std::size_t>(std::bit_width(depth), TreeStatistics::kDepthBuckets - 1)];
+            }
+
+            void RecordAllocations(std::size_t count) const {
+                counters.allocations += count;
+            }
+
+            void RecordDeallocation() const {
+                ++counters.deallocations;
+            }
+        };
+    };
+}
@@ -0,0 +1,590 @@
+#include "benchmark/benchmark.h"
+#include <bst.h>
+#include <btree.h>
+#include <concurrent_bst.h>
+#include <frozen_bst.h>
+#include <parallel.h>
+#include <persistence.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <numeric>
+#include <random>
+#include <set>
+#include <shared_mutex>
+#include <string>
+
+template<typename Allocator>
+using RedBlackTree = BST::BinarySearchTree<int, BST::InOrderTraversal, std::less<int>, Allocator, BST::RedBlackBalancing>;
+
+static std::vector<int> RandomKeys(std::size_t count, unsigned seed) {
+    std::mt19937 generator(seed);
+    std::vector<int> keys(count);
+    for (auto& key : keys) {
+        key = static_cast<int>(generator());
+    }
+
+    return keys;
+}
+
+// Builds a tree from scratch and tears it down: one allocation and one deallocation per key
+template<typename Allocator>
+static void BM_AllocatorInsertHeavy(benchmark::State& state) {
+    std::vector<int> keys = RandomKeys(state.range(0), 42);
+
+    for (auto _ : state) {
+        RedBlackTree<Allocator> bst;
+        for (int key : keys) {
+            bst.insert(key);
+        }
+        benchmark::DoNotOptimize(bst.size());
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Steady-state tree size, every iteration releases one node and allocates another
+template<typename Allocator>
+static void BM_AllocatorChurnHeavy(benchmark::State& state) {
+    std::vector<int> keys = RandomKeys(state.range(0), 42);
+    RedBlackTree<Allocator> bst;
+    for (int key : keys) {
+        bst.insert(key);
+    }
+
+    std::mt19937 generator(7);
+    std::size_t position = 0;
+    for (auto _ : state) {
+        bst.erase(keys[position]);
+        keys[position] = static_cast<int>(generator());
+        bst.insert(keys[position]);
+        position = (position + 1) % keys.size();
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template<typename Key>
+struct CountingLess {
+    inline static std::size_t comparisons = 0;
+
+    bool operator()(const Key& lhs, const Key& rhs) const {
+        ++comparisons;
+        return lhs < rhs;
+    }
+};
+
+struct CompositeKey {
+    std::int64_t tenant = 0;
+    std::string region;
+    std::int64_t id = 0;
+
+    auto operator<=>(const CompositeKey& rhs) const = default;
+};
+
+template<typename Key>
+static std::vector<Key> MakeKeys(std::size_t count, unsigned seed);
+
+template<>
+std::vector<std::string> MakeKeys<std::string>(std::size_t count, unsigned seed) {
+    std::vector<std::string> keys;
+    for (int key : RandomKeys(count, seed)) {
+        keys.push_back("/storage/cluster-01/volume/" + std::to_string(key));
+    }
+
+    return keys;
+}
+
+template<>
+std::vector<CompositeKey> MakeKeys<CompositeKey>(std::size_t count, unsigned seed) {
+    std::vector<CompositeKey> keys;
+    for (int key : RandomKeys(count, seed)) {
+        keys.push_back(CompositeKey{key % 4, "eu-central", key});
+    }
+
+    return keys;
+}
+
+// Reports comparator calls per insert: a single descent costs about one call per level plus one
+template<typename BalancingPolicy>
+static void BM_InsertComparisons(benchmark::State& state) {
+    std::vector<int> keys = RandomKeys(state.range(0), 42);
+    std::size_t total_comparisons = 0;
+
+    for (auto _ : state) {
+        BST::BinarySearchTree<int, BST::InOrderTraversal, CountingLess<int>, std::allocator<Node<int>>, BalancingPolicy> bst;
+        CountingLess<int>::comparisons = 0;
+        for (int key : keys) {
+            bst.insert(key);
+        }
+        total_comparisons += CountingLess<int>::comparisons;
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.counters["comparisons_per_insert"] = static_cast<double>(total_comparisons) / static_cast<double>(state.iterations() * state.range(0));
+}
+
+// Reports comparator calls per successful find: one per level plus the final equivalence check
+template<typename Key>
+static void BM_FindComparisons(benchmark::State& state) {
+    std::vector<Key> keys = MakeKeys<Key>(state.range(0), 42);
+    BST::BinarySearchTree<Key, BST::InOrderTraversal, CountingLess<Key>, std::allocator<Node<Key>>, BST::RedBlackBalancing> bst;
+    for (const auto& key : keys) {
+        bst.insert(key);
+    }
+
+    CountingLess<Key>::comparisons = 0;
+    std::size_t position = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(bst.find(keys[position]));
+        position = (position + 1) % keys.size();
+    }
+
+    state.counters["comparisons_per_find"] = static_cast<double>(CountingLess<Key>::comparisons) / static_cast<double>(state.iterations());
+}
+
+// Read-mostly lookups: the same keys probed in random order against the linked tree and its frozen copy
+template<typename Lookup>
+static void BM_ReadMostlyFind(benchmark::State& state) {
+    std::vector<int> keys = RandomKeys(state.range(0), 42);
+    RedBlackTree<std::allocator<Node<int>>> bst;
+    for (int key : keys) {
+        bst.insert(key);
+    }
+    Lookup lookup(bst);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(7));
+
+    std::size_t position = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lookup(keys[position]));
+        position = (position + 1 == keys.size()) ? 0 : position + 1;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+struct LinkedLookup {
+    const RedBlackTree<std::allocator<Node<int>>>& bst;
+
+    bool operator()(int key) const {
+        return bst.contains(key);
+    }
+};
+
+struct FrozenLookup {
+    BST::FrozenBinarySearchTree<int> frozen;
+
+    explicit FrozenLookup(const RedBlackTree<std::allocator<Node<int>>>& bst) : frozen(bst) {};
+
+    bool operator()(int key) const {
+        return frozen.contains(key);
+    }
+};
+
+struct WideNodeLookup {
+    BST::BPlusTree<int> tree;
+
+    explicit WideNodeLookup(const RedBlackTree<std::allocator<Node<int>>>& bst) : tree(bst.begin(), bst.end()) {};
+
+    bool operator()(int key) const {
+        return tree.contains(key);
+    }
+};
+
+// Shared lookups with one update in every 64 operations, the tree is built by the first thread
+template<typename SharedTree>
+static void BM_SharedReadMostly(benchmark::State& state) {
+    static SharedTree* shared = nullptr;
+    constexpr int kKeys = 1 << 20;
+    if (state.thread_index() == 0) {
+        shared = new SharedTree();
+        for (int key = 0; key < kKeys; key += 2) {
+            shared->insert(key);
+        }
+    }
+
+    std::mt19937 generator(state.thread_index());
+    std::uint64_t operation = 0;
+    for (auto _ : state) {
+        int key = static_cast<int>(generator() % kKeys);
+        if (++operation % 64 == 0) {
+            if (key % 2 == 0) {
+                shared->erase(key | 1);
+            } else {
+                shared->insert(key);
+            }
+        } else {
+            benchmark::DoNotOptimize(shared->contains(key));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0) {
+        delete shared;
+    }
+}
+
+// The baseline: the single-threaded tree behind a reader/writer lock
+struct LockedTree {
+    mutable std::shared_mutex mutex;
+    RedBlackTree<std::allocator<Node<int>>> bst;
+
+    void insert(int key) {
+        std::unique_lock lock(mutex);
+        bst.insert(key);
+    }
+
+    void erase(int key) {
+        std::unique_lock lock(mutex);
+        bst.erase(key);
+    }
+
+    bool contains(int key) const {
+        std::shared_lock lock(mutex);
+        return bst.contains(key);
+    }
+};
+
+// Bulk operations on 2^22-key trees with a pool of state.range(0) threads
+static void BM_ParallelCopy(benchmark::State& state) {
+    BST::TaskPool pool(state.range(0));
+    std::vector<int> keys(1 << 22);
+    std::iota(keys.begin(), keys.end(), 0);
+    RedBlackTree<std::allocator<Node<int>>> bst(BST::sorted_unique, keys.begin(), keys.end());
+
+    for (auto _ : state) {
+        auto copy = BST::parallel_copy(pool, bst);
+        benchmark::DoNotOptimize(copy.size());
+    }
+
+    state.SetItemsProcessed(state.iterations() * bst.size());
+}
+
+static void BM_ParallelUnion(benchmark::State& state) {
+    BST::TaskPool pool(state.range(0));
+    std::vector<int> lhs_keys = RandomKeys(1 << 22, 42);
+    std::vector<int> rhs_keys = RandomKeys(1 << 22, 43);
+    RedBlackTree<std::allocator<Node<int>>> lhs(lhs_keys.begin(), lhs_keys.end());
+    RedBlackTree<std::allocator<Node<int>>> rhs(rhs_keys.begin(), rhs_keys.end());
+
+    for (auto _ : state) {
+        auto united = BST::parallel_union(pool, lhs, rhs);
+        benchmark::DoNotOptimize(united.size());
+    }
+
+    state.SetItemsProcessed(state.iterations() * (lhs.size() + rhs.size()));
+}
+
+// Streaming ingest of increasing keys, as log sequence numbers arrive: a plain insert descends the whole
+// height every time, an end() hint attaches after the maximum with one comparison
+template<bool Hinted>
+static void BM_MonotonicIngest(benchmark::State& state) {
+    for (auto _ : state) {
+        RedBlackTree<std::allocator<Node<int>>> bst;
+        for (int key = 0; key < state.range(0); ++key) {
+            if constexpr (Hinted) {
+                bst.insert(bst.cend(), key);
+            } else {
+                bst.insert(key);
+            }
+        }
+        benchmark::DoNotOptimize(bst.size());
+        state.PauseTiming();
+        bst.clear();
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// A sorted probe list of half the tree's size, half of the keys present: one find per key against
+// find_batch, which walks from the previous answer
+template<bool Batched>
+static void BM_SortedBatchFind(benchmark::State& state) {
+    std::vector<int> keys = RandomKeys(state.range(0), 42);
+    RedBlackTree<std::allocator<Node<int>>> bst(keys.begin(), keys.end());
+    std::vector<int> queries = RandomKeys(state.range(0) / 4, 7);
+    queries.insert(queries.end(), keys.begin(), keys.begin() + state.range(0) / 4);
+    std::sort(queries.begin(), queries.end());
+    std::vector<RedBlackTree<std::allocator<Node<int>>>::iterator> results(queries.size());
+
+    for (auto _ : state) {
+        if constexpr (Batched) {
+            bst.find_batch(queries.begin(), queries.end(), results.begin());
+        } else {
+            for (std::size_t i = 0; i < queries.size(); ++i) {
+                results[i] = bst.find(queries[i]);
+            }
+        }
+        benchmark::DoNotOptimize(results.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+enum class StartupMode {
+    ReinsertDump,
+    LoadSnapshot,
+    MapSnapshot
+};
+
+// Startup from a saved tree of state.range(0) keys: inserting a sorted key dump one by one, bulk loading a
+// snapshot, or mapping it for lookups without building anything. The file stays in the page cache, so this
+// measures the work after the disk
+static void BM_Startup(benchmark::State& state, StartupMode mode) {
+    std::vector<int> keys = RandomKeys(state.range(0), 42);
+    RedBlackTree<std::allocator<Node<int>>> bst(keys.begin(), keys.end());
+    std::vector<int> dump(bst.begin(), bst.end());
+    auto path = std::filesystem::temp_directory_path() / "bst_bench_startup.snapshot";
+    BST::save(bst, path);
+
+    for (auto _ : state) {
+        if (mode == StartupMode::ReinsertDump) {
+            RedBlackTree<std::allocator<Node<int>>> loaded;
+            for (int key : dump) {
+                loaded.insert(key);
+            }
+            benchmark::DoNotOptimize(loaded.size());
+        } else if (mode == StartupMode::LoadSnapshot) {
+            auto loaded = BST::load<RedBlackTree<std::allocator<Node<int>>>>(path);
+            benchmark::DoNotOptimize(loaded.size());
+        } else {
+            BST::MappedSnapshot<int> snapshot(path);
+            benchmark::DoNotOptimize(snapshot.contains(keys.front()));
+        }
+    }
+
+    std::filesystem::remove(path);
+    state.SetItemsProcessed(state.iterations() * bst.size());
+}
+
+BENCHMARK_TEMPLATE(BM_AllocatorInsertHeavy, std::allocator<Node<int>>)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_AllocatorInsertHeavy, BST::SlabAllocator<Node<int>>)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_AllocatorChurnHeavy, std::allocator<Node<int>>)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_AllocatorChurnHeavy, BST::SlabAllocator<Node<int>>)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_InsertComparisons, BST::NoBalancing)->RangeMultiplier(16)->Range(1 << 10, 1 << 20);
+BENCHMARK_TEMPLATE(BM_InsertComparisons, BST::RedBlackBalancing)->RangeMultiplier(16)->Range(1 << 10, 1 << 20);
+BENCHMARK_TEMPLATE(BM_FindComparisons, std::string)->RangeMultiplier(16)->Range(1 << 10, 1 << 20);
+BENCHMARK_TEMPLATE(BM_FindComparisons, CompositeKey)->RangeMultiplier(16)->Range(1 << 10, 1 << 20);
+BENCHMARK_TEMPLATE(BM_ReadMostlyFind, LinkedLookup)->RangeMultiplier(8)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_ReadMostlyFind, FrozenLookup)->RangeMultiplier(8)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_ReadMostlyFind, WideNodeLookup)->RangeMultiplier(8)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_SharedReadMostly, LockedTree)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_SharedReadMostly, BST::ConcurrentBinarySearchTree<int>)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_ParallelCopy)->RangeMultiplier(2)->Range(1, 64)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ParallelUnion)->RangeMultiplier(2)->Range(1, 64)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_MonotonicIngest, false)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_MonotonicIngest, true)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_SortedBatchFind, false)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_SortedBatchFind, true)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_CAPTURE(BM_Startup, ReinsertDump, StartupMode::ReinsertDump)->RangeMultiplier(16)->Range(1 << 10, 1 << 22)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Startup, LoadSnapshot, StartupMode::LoadSnapshot)->RangeMultiplier(16)->Range(1 << 10, 1 << 22)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Startup, MapSnapshot, StartupMode::MapSnapshot)->RangeMultiplier(16)->Range(1 << 10, 1 << 22)->Unit(benchmark::kMillisecond);
+
+enum class KeyStream {
+    Random,
+    Sorted,
+    ReverseSorted,
+    Zipfian
+};
+
+// Zipf(0.99) ranks drawn with the rejection-free method of Gray et al. (as in YCSB), scattered over the key
+// space by a multiplicative hash so the hot keys do not all sit in one subtree
+static std::vector<int> ZipfianKeys(std::size_t count, unsigned seed) {
+    constexpr double theta = 0.99;
+    double zeta_n = 0;
+    for (std::size_t rank = 1; rank <= count; ++rank) {
+        zeta_n += 1.0 / std::pow(static_cast<double>(rank), theta);
+    }
+    double zeta_2 = 1.0 + 1.0 / std::pow(2.0, theta);
+    double alpha = 1.0 / (1.0 - theta);
+    double eta = (1.0 - std::pow(2.0 / static_cast<double>(count), 1.0 - theta)) / (1.0 - zeta_2 / zeta_n);
+
+    std::mt19937_64 generator(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::vector<int> keys(count);
+    for (auto& key : keys) {
+        double u = uniform(generator);
+        double uz = u * zeta_n;
+        std::uint64_t rank = 0;
+        if (uz >= 1.0) {
+            rank = (uz < zeta_2) ? 1 : static_cast<std::uint64_t>(static_cast<double>(count) * std::pow(eta * u - eta + 1.0, alpha));
+        }
+        key = static_cast<int>(static_cast<std::uint32_t>(rank * 0x9E3779B97F4A7C15ULL >> 32));
+    }
+
+    return keys;
+}
+
+static std::vector<int> MakeStream(KeyStream stream, std::size_t count) {
+    switch (stream) {
+        case KeyStream::Random:
+            return RandomKeys(count, 42);
+        case KeyStream::Sorted: {
+            std::vector<int> keys(count);
+            std::iota(keys.begin(), keys.end(), 0);
+            return keys;
+        }
+        case KeyStream::ReverseSorted: {
+            std::vector<int> keys(count);
+            std::iota(keys.rbegin(), keys.rend(), 0);
+            return keys;
+        }
+        case KeyStream::Zipfian:
+            return ZipfianKeys(count, 42);
+    }
+
+    return {};
+}
+
+static const char* StreamName(KeyStream stream) {
+    switch (stream) {
+        case KeyStream::Random:
+            return "random";
+        case KeyStream::Sorted:
+            return "sorted";
+        case KeyStream::ReverseSorted:
+            return "reverse_sorted";
+        case KeyStream::Zipfian:
+            return "zipfian";
+    }
+
+    return "";
+}
+
+// The tree is measured with red-black balancing: without it the sorted streams degenerate into lists
+// and the large sizes never finish
+template<typename TraversalTag>
+using BenchmarkTree = BST::BinarySearchTree<int, TraversalTag, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing>;
+
+template<typename Container>
+static Container Fill(const std::vector<int>& keys) {
+    Container container;
+    for (int key : keys) {
+        container.insert(key);
+    }
+
+    return container;
+}
+
+template<typename Container>
+static void BM_Insert(benchmark::State& state, KeyStream stream) {
+    std::vector<int> keys = MakeStream(stream, state.range(0));
+
+    for (auto _ : state) {
+        Container container = Fill<Container>(keys);
+        benchmark::DoNotOptimize(container.size());
+        state.PauseTiming();
+        container.clear();
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template<typename Container>
+static void BM_Find(benchmark::State& state, KeyStream stream) {
+    std::vector<int> keys = MakeStream(stream, state.range(0));
+    Container container = Fill<Container>(keys);
+
+    std::size_t position = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(container.find(keys[position]));
+        position = (position + 1 == keys.size()) ? 0 : position + 1;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template<typename Container>
+static void BM_LowerBound(benchmark::State& state, KeyStream stream) {
+    std::vector<int> keys = MakeStream(stream, state.range(0));
+    Container container = Fill<Container>(keys);
+
+    std::size_t position = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(container.lower_bound(keys[position] + 1));
+        position = (position + 1 == keys.size()) ? 0 : position + 1;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template<typename Container>
+static void BM_Erase(benchmark::State& state, KeyStream stream) {
+    std::vector<int> keys = MakeStream(stream, state.range(0));
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        Container container = Fill<Container>(keys);
+        state.ResumeTiming();
+        for (int key : keys) {
+            container.erase(key);
+        }
+        benchmark::DoNotOptimize(container.size());
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template<typename Container>
+static void BM_Iterate(benchmark::State& state, KeyStream stream) {
+    Container container = Fill<Container>(MakeStream(stream, state.range(0)));
+
+    for (auto _ : state) {
+        std::int64_t sum = 0;
+        for (int key : container) {
+            sum += key;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+
+    state.SetItemsProcessed(state.iterations() * container.size());
+}
+
+template<typename Container>
+static void RegisterOperations(const std::string& container_name, std::int64_t max_elements) {
+    using Operation = void (*)(benchmark::State&, KeyStream);
+    const std::pair<const char*, Operation> operations[] = {
+            {"BM_Insert", BM_Insert<Container>},
+            {"BM_Find", BM_Find<Container>},
+            {"BM_LowerBound", BM_LowerBound<Container>},
+            {"BM_Erase", BM_Erase<Container>},
+            {"BM_Iterate", BM_Iterate<Container>},
+    };
+
+    for (const auto& [operation_name, operation] : operations) {
+        for (KeyStream stream : {KeyStream::Random, KeyStream::Sorted, KeyStream::ReverseSorted, KeyStream::Zipfian}) {
+            std::string name = std::string(operation_name) + "/" + container_name + "/" + StreamName(stream);
+            auto* registered = benchmark::RegisterBenchmark(name.c_str(), [operation, stream](benchmark::State& state) {
+                operation(state, stream);
+            });
+            for (std::int64_t elements = 1000; elements <= max_elements; elements *= 10) {
+                registered->Arg(elements);
+            }
+            registered->Unit(benchmark::kMicrosecond);
+        }
+    }
+}
+
+// BST_BENCH_MAX_ELEMENTS caps the 1K..100M size sweep of the operation matrix on smaller machines
+int main(int argc, char** argv) {
+    std::int64_t max_elements = 100'000'000;
+    if (const char* limit = std::getenv("BST_BENCH_MAX_ELEMENTS")) {
+        max_elements = std::atoll(limit);
+    }
+
+    RegisterOperations<BenchmarkTree<BST::PreOrderTraversal>>("bst_pre_order", max_elements);
+    RegisterOperations<BenchmarkTree<BST::InOrderTraversal>>("bst_in_order", max_elements);
+    RegisterOperations<BenchmarkTree<BST::PostOrderTraversal>>("bst_post_order", max_elements);
+    RegisterOperations<std::set<int>>("std_set", max_elements);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    return 0;
+}
@@ -1,5 +1,20 @@
 #include "gtest/gtest.h"
 #include <bst.h>
+#include <btree.h>
+#include <concurrent_bst.h>
+#include <frozen_bst.h>
+#include <map.h>
+#include <parallel.h>
+#include <persistence.h>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <pthread.h>
+#include <set>
+#include <thread>
 
 TEST(ConstructorsTestSuite, DefaultConstructor_PreOrderTraversal) {
     BST::BinarySearchTree<int, BST::PreOrderTraversal> bst;
@@ -42,6 +57,32 @@ TEST(ConstructorsTestSuite, CopyConstructor_PostOrderTraversal) {
     ASSERT_EQ(bst, bst_copy);
 }
 
+TEST(ConstructorsTestSuite, MoveConstructorKeepsNodes_PostOrderTraversal) {
+    using Tree = BST::BinarySearchTree<int, BST::PostOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing>;
+    static_assert(std::is_nothrow_move_constructible_v<Tree>);
+    std::vector<Tree> trees(1);
+    trees[0].insert({5, 3, 8});
+    const int* first_key = &*trees[0].find(5);
+    for (int i = 0; i < 100; ++i) {
+        trees.emplace_back(Tree{i});
+    }
+    Tree moved(std::move(trees[0]));
+    bool reused = trees[0].empty() && trees[0].begin() == trees[0].end() && trees[0].find(5) == trees[0].end();
+    trees[0].insert(trees[0].cend(), 2);
+    trees[0].emplace(1);
+    trees[0].merge(Tree{7, 9});
+    std::vector<int> expected_keys = {1, 7, 9, 2};
+    std::sort(expected_keys.begin(), expected_keys.end());
+    std::vector<int> keys = trees[0].TraversalToVector();
+    std::sort(keys.begin(), keys.end());
+    bool nodes_kept = &*moved.find(5) == first_key && moved.size() == 3;
+    Tree drained = {4};
+    moved = std::move(drained);
+    drained = Tree(std::move(moved));
+
+    ASSERT_TRUE(reused && keys == expected_keys && nodes_kept && moved.empty() && drained.TraversalToVector() == std::vector<int>{4});
+}
+
 TEST(ConstructorsTestSuite, InitializerListConstructor_PreOrderTraversal) {
     BST::BinarySearchTree<std::vector<double>, BST::PreOrderTraversal> bst({{1, 2.33, 3}, {10, -11.0001, 31.88}, {-1}, {23, 31.1}});
     std::vector<std::vector<double>> correct_traversal = {{1, 2.33, 3}, {-1}, {10, -11.0001, 31.88}, {23, 31.1}};
@@ -184,6 +225,55 @@ TEST(MethodsTestSuite, DoubleInsert) {
     ASSERT_EQ(bst.count("new_string"), 1);
 }
 
+struct CountingKey {
+    static inline int copies = 0;
+    static inline int moves = 0;
+
+    int value = 0;
+    std::string payload;
+
+    CountingKey() = default;
+    CountingKey(int key_value, std::string key_payload) : value(key_value), payload(std::move(key_payload)) {}
+    CountingKey(const CountingKey& other) : value(other.value), payload(other.payload) { ++copies; }
+    CountingKey(CountingKey&& other) noexcept : value(other.value), payload(std::move(other.payload)) { ++moves; }
+    CountingKey& operator=(const CountingKey&) = default;
+    CountingKey& operator=(CountingKey&&) = default;
+
+    bool operator<(const CountingKey& rhs) const {
+        return value < rhs.value;
+    }
+};
+
+TEST(MethodsTestSuite, InsertAndEmplaceCopiesAndMoves) {
+    BST::BinarySearchTree<CountingKey, BST::InOrderTraversal, std::less<CountingKey>, std::allocator<Node<CountingKey>>, BST::RedBlackBalancing> bst;
+    CountingKey::copies = CountingKey::moves = 0;
+    CountingKey lvalue(1, "one");
+    bst.insert(lvalue);
+    bool lvalue_copied_once = CountingKey::copies == 1 && CountingKey::moves == 0;
+    bst.insert(CountingKey(2, "two"));
+    bool rvalue_moved_once = CountingKey::copies == 1 && CountingKey::moves == 1;
+    bst.emplace(3, "three");
+    auto [duplicate, duplicate_inserted] = bst.emplace(3, "again");
+    auto hinted = bst.emplace_hint(bst.end(), 4, "four");
+    bool emplaced_in_place = CountingKey::copies == 1 && CountingKey::moves == 1;
+    CountingKey present(2, "two");
+    bst.insert(std::move(present));
+
+    ASSERT_TRUE(lvalue_copied_once && rvalue_moved_once && emplaced_in_place && CountingKey::moves == 1 && present.payload == "two"
+                && !duplicate_inserted && (*duplicate).payload == "three" && (*hinted).value == 4 && bst.size() == 4);
+}
+
+TEST(MethodsTestSuite, InsertUpdatesBegin_PostOrderTraversal) {
+    BST::BinarySearchTree<int, BST::PostOrderTraversal> bst = {5, 3, 8};
+    bst.insert(4);
+    std::vector<int> traversal_after_first_insert = bst.TraversalToVector();
+    bst.insert(1);
+    bst.insert(9);
+    std::vector<int> correct_traversal_1 = {4, 3, 8, 5}, correct_traversal_2 = {1, 4, 3, 9, 8, 5};
+
+    ASSERT_TRUE(traversal_after_first_insert == correct_traversal_1 && bst.TraversalToVector() == correct_traversal_2);
+}
+
 TEST(MethodsTestSuite, InsertByIterators) {
     BST::BinarySearchTree<char, BST::InOrderTraversal> bst_1 = {'d', 'c', 'b', 'a'}, bst_2;
     bst_2.insert(++bst_1.begin(), bst_1.end());
@@ -227,6 +317,31 @@ TEST(MethodsTestSuite, ExtractByIteratorInvalid) {
     ASSERT_THROW(bst.extract(bst.cend()), std::runtime_error);
 }
 
+TEST(MethodsTestSuite, InsertNodeHandleRelinksNode_InOrderTraversal) {
+    BST::BinarySearchTree<std::string, BST::InOrderTraversal> bst_1 = {"a", "b", "c"}, bst_2 = {"x"};
+    auto element = bst_1.extract("b");
+    const std::string* key_address = &element.value();
+    auto result = bst_2.insert(std::move(element));
+    std::vector<std::string> correct_traversal = {"b", "x"};
+
+    ASSERT_TRUE(result.inserted && &*result.position == key_address && element.empty() && bst_1.size() == 2
+                && bst_2.TraversalToVector() == correct_traversal);
+}
+
+TEST(MethodsTestSuite, InsertNodeHandleWithChangedKey_PostOrderTraversal) {
+    BST::BinarySearchTree<int, BST::PostOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing> bst = {1, 2, 3, 4, 5};
+    auto element = bst.extract(1);
+    element.value() = 6;
+    auto result = bst.insert(std::move(element));
+    auto duplicate = bst.extract(2);
+    duplicate.value() = 4;
+    auto rejected = bst.insert(std::move(duplicate));
+    std::vector<int> correct_traversal = {3, 6, 5, 4};
+
+    ASSERT_TRUE(result.inserted && *result.position == 6 && !rejected.inserted && *rejected.position == 4
+                && rejected.node.value() == 4 && bst.TraversalToVector() == correct_traversal);
+}
+
 TEST(MethodsTestSuite, EraseByKeyExistingElement) {
     BST::BinarySearchTree<char, BST::InOrderTraversal> bst = {'\0', '@', 'a'};
 
@@ -254,6 +369,28 @@ TEST(MethodsTestSuite, EraseByIteratorsRange) {
     ASSERT_TRUE(it == bst.end() && bst.empty());
 }
 
+TEST(MethodsTestSuite, EraseByIteratorsSubrange_InOrderTraversal) {
+    BST::BinarySearchTree<int, BST::InOrderTraversal> bst = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    auto it = bst.erase(std::next(bst.cbegin(), 2), std::next(bst.cbegin(), 7));
+    std::vector<int> correct_traversal = {1, 2, 8, 9, 10};
+
+    ASSERT_TRUE(*it == 8 && bst.TraversalToVector() == correct_traversal && bst.size() == 5);
+}
+
+TEST(MethodsTestSuite, EraseByIteratorsSubrange_PreOrderTraversal) {
+    BST::BinarySearchTree<int, BST::PreOrderTraversal> bst;
+    for (int value : {5, 3, 8, 1, 4, 7, 9}) {
+        bst.insert(value);
+    }
+    auto it1 = bst.cbegin(), it2 = bst.cbegin();
+    std::advance(it1, 1);
+    std::advance(it2, 5);
+    auto it = bst.erase(it1, it2);
+    std::vector<int> correct_traversal = {5, 9, 7};
+
+    ASSERT_TRUE(*it == 7 && bst.TraversalToVector() == correct_traversal && bst.size() == 3);
+}
+
 TEST(MethodsTestSuite, MergeTest) {
     BST::BinarySearchTree<int, BST::InOrderTraversal> bst_1 = {1, 3, 5, 7, 9}, bst_2 = {2, 4, 6, 8, 10};
     bst_1.merge(bst_2);
@@ -262,6 +399,17 @@ TEST(MethodsTestSuite, MergeTest) {
     ASSERT_EQ(bst_1.TraversalToVector(), correct_traversal);
 }
 
+TEST(MethodsTestSuite, MergeSplicesNodes_PreOrderTraversal) {
+    BST::BinarySearchTree<int, BST::PreOrderTraversal> bst_1 = {2, 1, 3}, bst_2 = {3, 4, 0};
+    const int* key_address = &*bst_2.find(4);
+    bst_1.merge(bst_2);
+    std::vector<int> correct_traversal = {2, 1, 0, 3, 4};
+    std::vector<int> rest_traversal = {3};
+
+    ASSERT_TRUE(bst_1.TraversalToVector() == correct_traversal && bst_2.TraversalToVector() == rest_traversal
+                && &*bst_1.find(4) == key_address && bst_1.size() == 5 && bst_2.size() == 1);
+}
+
 TEST(MethodsTestSuite, FindTestExistingElement) {
     BST::BinarySearchTree<std::string, BST::PreOrderTraversal> bst = {"here", "yes"};
 
@@ -274,6 +422,37 @@ TEST(MethodsTestSuite, FindTestNonExistentElement) {
     ASSERT_TRUE(bst.find("no") == bst.end());
 }
 
+struct CaseInsensitiveLess {
+    bool operator()(const std::string& lhs, const std::string& rhs) const {
+        return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](char a, char b) {
+            return std::tolower(a) < std::tolower(b);
+        });
+    }
+};
+
+struct CountingIntLess {
+    inline static int comparisons = 0;
+
+    bool operator()(int lhs, int rhs) const {
+        ++comparisons;
+        return lhs < rhs;
+    }
+};
+
+TEST(MethodsTestSuite, FindTestUsesComparatorEquivalence) {
+    BST::BinarySearchTree<std::string, BST::InOrderTraversal, CaseInsensitiveLess> bst = {"Apple", "banana", "Cherry"};
+
+    ASSERT_TRUE(*bst.find("APPLE") == "Apple" && bst.contains("cherry") && bst.erase("BANANA") == 1 && bst.size() == 2);
+}
+
+TEST(MethodsTestSuite, FindTestOneComparisonPerLevel) {
+    BST::BinarySearchTree<int, BST::PreOrderTraversal, CountingIntLess> bst = {4, 2, 6, 1, 3, 5, 7};
+    CountingIntLess::comparisons = 0;
+    bst.find(3);
+
+    ASSERT_EQ(CountingIntLess::comparisons, bst.height() + 1);
+}
+
 TEST(MethodsTestSuite, CountTestExistingElement) {
     BST::BinarySearchTree<double, BST::InOrderTraversal> bst = {2.3, -1.1, 100};
 
@@ -353,4 +532,1384 @@ TEST(MethodsTestSuite, SwapTest) {
     std::vector<std::string> correct_traversal_1 = {"first", "second"}, correct_traversal_2 = {"third"};
 
     ASSERT_TRUE(bst_1.TraversalToVector() == correct_traversal_2 && bst_2.TraversalToVector() == correct_traversal_1);
-}
\ No newline at end of file
+}
+
+TEST(BalancingTestSuite, RedBlackSortedInsertHeight) {
+    BST::BinarySearchTree<int, BST::InOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing> bst;
+    const int elements_count = 10'000'000;
+    for (int i = 0; i < elements_count; ++i) {
+        bst.insert(i);
+    }
+
+    ASSERT_TRUE(bst.size() == elements_count && bst.height() <= 2 * std::log2(elements_count + 1));
+}
+
+TEST(BalancingTestSuite, AvlSortedInsertHeight) {
+    BST::BinarySearchTree<int, BST::PreOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::AvlBalancing> bst;
+    const int elements_count = 1'000'000;
+    for (int i = elements_count; i > 0; --i) {
+        bst.insert(i);
+    }
+
+    ASSERT_TRUE(bst.size() == elements_count && bst.height() <= 1.45 * std::log2(elements_count + 2));
+}
+
+TEST(BalancingTestSuite, RedBlackEraseKeepsOrder_PostOrderTraversal) {
+    BST::BinarySearchTree<int, BST::PostOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing> bst;
+    std::set<int> correct_set;
+    for (int i = 0; i < 2000; ++i) {
+        int key = (i * 7919) % 1009;
+        bst.insert(key);
+        correct_set.insert(key);
+        if (i % 3 == 0) {
+            bst.erase(key / 2);
+            correct_set.erase(key / 2);
+        }
+    }
+    std::vector<int> traversal = bst.TraversalToVector();
+    std::vector<int> reverse_traversal = std::vector<int>(bst.rbegin(), bst.rend());
+    std::reverse(reverse_traversal.begin(), reverse_traversal.end());
+    std::sort(traversal.begin(), traversal.end());
+
+    ASSERT_TRUE(traversal == std::vector<int>(correct_set.begin(), correct_set.end()) && traversal.size() == bst.size()
+                && bst.TraversalToVector() == reverse_traversal && bst.height() <= 2 * std::log2(bst.size() + 1));
+}
+
+TEST(BalancingTestSuite, AvlEraseKeepsOrder_InOrderTraversal) {
+    BST::BinarySearchTree<int, BST::InOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::AvlBalancing> bst;
+    std::set<int> correct_set;
+    for (int i = 0; i < 2000; ++i) {
+        bst.insert(i);
+        correct_set.insert(i);
+    }
+    for (int i = 0; i < 2000; i += 3) {
+        bst.erase(i);
+        correct_set.erase(i);
+    }
+    std::vector<int> reverse_traversal = std::vector<int>(bst.rbegin(), bst.rend());
+    std::reverse(reverse_traversal.begin(), reverse_traversal.end());
+
+    ASSERT_TRUE(bst.TraversalToVector() == std::vector<int>(correct_set.begin(), correct_set.end())
+                && bst.TraversalToVector() == reverse_traversal && bst.height() <= 1.45 * std::log2(bst.size() + 2));
+}
+
+TEST(BalancingTestSuite, CopyKeepsBalance_PreOrderTraversal) {
+    BST::BinarySearchTree<int, BST::PreOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing> bst;
+    for (int i = 0; i < 100; ++i) {
+        bst.insert(i);
+    }
+    auto bst_copy = bst;
+    for (int i = 100; i < 1000; ++i) {
+        bst_copy.insert(i);
+    }
+
+    ASSERT_TRUE(bst.size() == 100 && bst_copy.size() == 1000 && bst_copy.height() <= 2 * std::log2(1001));
+}
+
+template<typename Tree>
+bool SetAlgebraMatchesStdAlgorithms() {
+    Tree lhs;
+    Tree rhs;
+    for (int i = 0; i < 3000; ++i) {
+        lhs.insert((i * 7919) % 5000);
+        if (i % 4 != 0) {
+            rhs.insert(static_cast<int>((i * 104729LL) % 9000));
+        }
+    }
+    std::vector<int> lhs_keys = lhs.TraversalToVector();
+    std::vector<int> rhs_keys = rhs.TraversalToVector();
+    std::sort(lhs_keys.begin(), lhs_keys.end());
+    std::sort(rhs_keys.begin(), rhs_keys.end());
+    std::vector<int> expected_union;
+    std::vector<int> expected_intersection;
+    std::vector<int> expected_difference;
+    std::set_union(lhs_keys.begin(), lhs_keys.end(), rhs_keys.begin(), rhs_keys.end(), std::back_inserter(expected_union));
+    std::set_intersection(lhs_keys.begin(), lhs_keys.end(), rhs_keys.begin(), rhs_keys.end(), std::back_inserter(expected_intersection));
+    std::set_difference(lhs_keys.begin(), lhs_keys.end(), rhs_keys.begin(), rhs_keys.end(), std::back_inserter(expected_difference));
+    auto links_intact = [](const Tree& tree) {
+        std::vector<int> reverse_traversal(tree.rbegin(), tree.rend());
+        std::reverse(reverse_traversal.begin(), reverse_traversal.end());
+
+        return tree.TraversalToVector() == reverse_traversal && reverse_traversal.size() == tree.size();
+    };
+
+    Tree united = lhs;
+    Tree merged_away = rhs;
+    united.merge(merged_away);
+    Tree common = lhs;
+    common.intersect(Tree(rhs));
+    Tree rest = lhs;
+    rest.subtract(Tree(rhs));
+    united.insert(-1);
+    common.insert(-1);
+    rest.erase(rest.find(expected_difference.front()));
+    std::vector<int> united_keys = united.TraversalToVector();
+    std::vector<int> common_keys = common.TraversalToVector();
+    std::vector<int> rest_keys = rest.TraversalToVector();
+    std::sort(united_keys.begin(), united_keys.end());
+    std::sort(common_keys.begin(), common_keys.end());
+    std::sort(rest_keys.begin(), rest_keys.end());
+    expected_union.insert(expected_union.begin(), -1);
+    expected_intersection.insert(expected_intersection.begin(), -1);
+    expected_difference.erase(expected_difference.begin());
+
+    return united_keys == expected_union && common_keys == expected_intersection && rest_keys == expected_difference
+           && merged_away.size() == expected_intersection.size() - 1 && united.size() == expected_union.size()
+           && links_intact(united) && links_intact(common) && links_intact(rest) && links_intact(merged_away);
+}
+
+TEST(SetAlgebraTestSuite, MatchesStdAlgorithms_RedBlack) {
+    using Tree = BST::BinarySearchTree<int, BST::InOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing>;
+
+    ASSERT_TRUE(SetAlgebraMatchesStdAlgorithms<Tree>());
+}
+
+TEST(SetAlgebraTestSuite, MatchesStdAlgorithms_Avl) {
+    using Tree = BST::BinarySearchTree<int, BST::PreOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::AvlBalancing, BST::OrderStatistics>;
+
+    ASSERT_TRUE(SetAlgebraMatchesStdAlgorithms<Tree>());
+}
+
+TEST(SetAlgebraTestSuite, MatchesStdAlgorithms_NoBalancing) {
+    using Tree = BST::BinarySearchTree<int, BST::PostOrderTraversal>;
+
+    ASSERT_TRUE(SetAlgebraMatchesStdAlgorithms<Tree>());
+}
+
+TEST(SetAlgebraTestSuite, EachTreeCountsItsOwnFrees_InOrderTraversal) {
+    using Tree = BST::BinarySearchTree<int, BST::InOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::AvlBalancing, BST::CollectStatistics>;
+    Tree kept;
+    Tree other;
+    for (int i = 0; i < 300; ++i) {
+        kept.insert(i);
+        other.insert(2 * i);
+    }
+    kept.intersect(other);
+    bool intersected = kept.size() == 150 && kept.stats().deallocations == 150 && other.stats().deallocations == 300 && other.empty();
+    Tree subtracted;
+    for (int i = 0; i < 100; ++i) {
+        subtracted.insert(i);
+        other.insert(3 * i);
+    }
+    other.reset_stats();
+    subtracted.subtract(other);
+
+    ASSERT_TRUE(intersected && subtracted.size() == 66 && subtracted.stats().deallocations == 34 && other.stats().deallocations == 100
+                && other.empty() && static_cast<Tree::size_type>(std::distance(subtracted.begin(), subtracted.end())) == subtracted.size());
+}
+
+TEST(SetAlgebraTestSuite, SplitAndJoinRoundTrip_PostOrderTraversal) {
+    BST::BinarySearchTree<int, BST::PostOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing> bst;
+    for (int i = 0; i < 4000; ++i) {
+        bst.insert((i * 7919) % 6000);
+    }
+    auto original = bst;
+    auto same_keys = [&original](const auto& tree) {
+        return tree.size() == original.size() && std::is_permutation(tree.begin(), tree.end(), original.begin());
+    };
+    bool split_ok = true;
+    for (int pivot : {-10, 0, 1, 2999, 3000, 5999, 6000}) {
+        auto upper = bst.split(pivot);
+        split_ok = split_ok && bst.size() + upper.size() == original.size() && (bst.empty() || *std::max_element(bst.begin(), bst.end()) < pivot)
+                   && (upper.empty() || *std::min_element(upper.begin(), upper.end()) >= pivot)
+                   && bst.height() <= 2 * std::log2(bst.size() + 1) && upper.height() <= 2 * std::log2(upper.size() + 1)
+                   && std::vector<int>(upper.rbegin(), upper.rend()).size() == upper.size();
+        bst.join(upper);
+        split_ok = split_ok && upper.empty() && same_keys(bst);
+    }
+    auto upper = bst.split(3000);
+    bool rejected = false;
+    try {
+        upper.join(bst);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+
+    ASSERT_TRUE(split_ok && rejected && bst.size() + upper.size() == original.size());
+}
+
+TEST(SetAlgebraTestSuite, RedBlackResultsAcceptInserts_InOrderTraversal) {
+    using Tree = BST::BinarySearchTree<int, BST::InOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing>;
+    auto grows_balanced = [](Tree& tree, int first_key) {
+        std::size_t expected_size = tree.size() + 500;
+        for (int i = 0; i < 500; ++i) {
+            tree.insert(first_key + i);
+        }
+
+        return tree.size() == expected_size && std::is_sorted(tree.begin(), tree.end())
+               && tree.height() <= 2 * std::log2(tree.size() + 1);
+    };
+    Tree small = {1, 0, 2};
+    Tree small_upper = small.split(1);
+    bool inserted = grows_balanced(small, 5) && grows_balanced(small_upper, 1000);
+    for (int seed = 1; seed <= 20; ++seed) {
+        Tree lhs;
+        Tree rhs;
+        for (int i = 0; i < 200; ++i) {
+            lhs.insert((i * 37 + seed * 11) % 300);
+            rhs.insert((i * 53 + seed * 7) % 300);
+        }
+        Tree upper = lhs.split(seed * 13);
+        Tree common = upper;
+        common.intersect(Tree(rhs));
+        Tree rest = lhs;
+        rest.subtract(Tree(rhs));
+        inserted = inserted && grows_balanced(lhs, 10000) && grows_balanced(upper, 10000)
+                   && grows_balanced(common, 10000) && grows_balanced(rest, 10000);
+    }
+
+    ASSERT_TRUE(inserted);
+}
+
+TEST(StatisticsTestSuite, CountsDegenerateTree_InOrderTraversal) {
+    BST::BinarySearchTree<int, BST::InOrderTraversal, CountingIntLess, std::allocator<Node<int>>, BST::CollectStatistics> bst;
+    CountingIntLess::comparisons = 0;
+    for (int i = 1; i <= 100; ++i) {
+        bst.insert(i);
+    }
+    bst.find(100);
+    bst.erase(1);
+    bst.lower_bound(1000);
+    BST::TreeStatistics stats = bst.stats();
+    bst.clear();
+    bst.reset_stats();
+    bst.insert(7);
+
+    ASSERT_TRUE(stats.comparisons == static_cast<std::uint64_t>(CountingIntLess::comparisons) && stats.inserts == 100
+                && stats.insert_visits == 99 * 100 / 2 && stats.searches == 2 && stats.search_visits == 100 + 99
+                && stats.erases == 1 && stats.erase_visits == 1 && stats.allocations == 100 + 1 && stats.deallocations == 1
+                && stats.max_depth == 100 && stats.height == 99 && stats.depth_histogram[0] == 1 && stats.depth_histogram[7] == 38
+                && bst.stats().allocations == 1 && bst.stats().deallocations == 0 && bst.stats().inserts == 1);
+}
+
+TEST(StatisticsTestSuite, NodeHandlesMoveAllocationsBetweenTrees_InOrderTraversal) {
+    using Tree = BST::BinarySearchTree<int, BST::InOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::AvlBalancing, BST::CollectStatistics>;
+    Tree source;
+    Tree target;
+    for (int i = 0; i < 100; ++i) {
+        source.insert(i);
+    }
+    for (int i = 0; i < 100; i += 2) {
+        target.insert(source.extract(i));
+    }
+    Tree other = {2};
+    auto reinserted = target.insert(target.extract(0));
+    auto rejected = target.insert(other.extract(2));
+    BST::TreeStatistics source_stats = source.stats();
+    BST::TreeStatistics target_stats = target.stats();
+    BST::TreeStatistics other_stats = other.stats();
+
+    ASSERT_TRUE(reinserted.inserted && !rejected.inserted && !rejected.node.empty() && target.size() == 50
+                && source_stats.allocations - source_stats.deallocations == source.size() + 1 && source_stats.deallocations == 50
+                && target_stats.allocations - target_stats.deallocations == target.size() + 1 && target_stats.deallocations == 1
+                && other_stats.allocations == 2 && other_stats.deallocations == 1);
+}
+
+TEST(StatisticsTestSuite, DisabledStatisticsTakeNoSpace_PreOrderTraversal) {
+    using PlainTree = BST::BinarySearchTree<int, BST::PreOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::AvlBalancing>;
+    using CountingTree = BST::BinarySearchTree<int, BST::PreOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::AvlBalancing, BST::CollectStatistics>;
+    static_assert(sizeof(BST::BinarySearchTree<int, BST::PreOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::AvlBalancing, BST::NoStatistics>) == sizeof(PlainTree));
+    CountingTree bst;
+    for (int i = 0; i < 1 << 12; ++i) {
+        bst.insert(i);
+    }
+    BST::TreeStatistics stats = bst.stats();
+
+    ASSERT_TRUE(!PlainTree::kCollectsStatistics && stats.height <= 13 && stats.max_depth < 13
+                && stats.depth_histogram[std::bit_width(8u)] > 3900);
+}
+
+TEST(MapTestSuite, SubscriptAtAndAssignment) {
+    BST::Map<std::string, int> word_counts;
+    for (const char* word : {"tree", "map", "tree", "node", "tree", "map"}) {
+        ++word_counts[word];
+    }
+    auto [assigned, assigned_inserted] = word_counts.insert_or_assign("node", 10);
+    auto [added, added_inserted] = word_counts.insert_or_assign("leaf", 1);
+    bool missing_rejected = false;
+    try {
+        word_counts.at("root");
+    } catch (const std::out_of_range&) {
+        missing_rejected = true;
+    }
+    std::vector<std::pair<const std::string, int>> expected = {{"leaf", 1}, {"map", 2}, {"node", 10}, {"tree", 3}};
+
+    ASSERT_TRUE(std::equal(word_counts.begin(), word_counts.end(), expected.begin(), expected.end()) && word_counts.at("tree") == 3
+                && !assigned_inserted && assigned->second == 10 && added_inserted && added->first == "leaf" && missing_rejected);
+}
+
+TEST(MapTestSuite, TryEmplaceBuildsValueInNode) {
+    BST::Map<int, std::unique_ptr<std::string>> owners;
+    auto [first, first_inserted] = owners.try_emplace(1, std::make_unique<std::string>("one"));
+    const std::string* first_address = first->second.get();
+    auto replacement = std::make_unique<std::string>("uno");
+    auto [again, again_inserted] = owners.try_emplace(1, std::move(replacement));
+    owners.try_emplace(2, new std::string("two"));
+    owners.emplace(3, std::make_unique<std::string>("three"));
+    for (auto& [key_value, owner] : owners) {
+        *owner += "!";
+    }
+    std::string joined;
+    for (auto it = owners.crbegin(); it != owners.crend(); ++it) {
+        joined += *it->second;
+    }
+
+    ASSERT_TRUE(first_inserted && !again_inserted && replacement != nullptr && again->second.get() == first_address
+                && joined == "three!two!one!" && owners.size() == 3);
+}
+
+TEST(MapTestSuite, MatchesStdMapUnderChurn) {
+    BST::Map<int, long long, std::less<int>, std::allocator<std::pair<const int, long long>>, BST::RedBlackBalancing, BST::OrderStatistics> map;
+    std::map<int, long long> correct_map;
+    for (int i = 0; i < 20000; ++i) {
+        int key_value = static_cast<int>((i * 7919LL) % 3001);
+        if (i % 5 == 0) {
+            map.erase(key_value);
+            correct_map.erase(key_value);
+        } else if (i % 5 == 1) {
+            map.insert_or_assign(key_value, i);
+            correct_map.insert_or_assign(key_value, i);
+        } else {
+            map[key_value] += i;
+            correct_map[key_value] += i;
+        }
+    }
+    auto bound = map.lower_bound(1500);
+    auto correct_bound = correct_map.lower_bound(1500);
+
+    ASSERT_TRUE(std::equal(map.begin(), map.end(), correct_map.begin(), correct_map.end()) && map.size() == correct_map.size()
+                && bound->first == correct_bound->first && map.find(-1) == map.end() && map.count(correct_map.begin()->first) == 1);
+}
+
+TEST(MapTestSuite, TransparentBoundsTakeOtherKeyTypes) {
+    BST::Map<std::string, int, std::less<>> prices = {{"apple", 3}, {"cherry", 7}, {"melon", 5}};
+    const auto& const_prices = prices;
+    std::string_view probe = "banana";
+    auto lower = prices.lower_bound(probe);
+    auto upper = const_prices.upper_bound(std::string_view("cherry"));
+    lower->second = 8;
+
+    ASSERT_TRUE(lower->first == "cherry" && upper->first == "melon" && prices.lower_bound("zebra") == prices.end()
+                && const_prices.find(std::string_view("cherry"))->second == 8);
+}
+
+template<typename... Policies>
+concept MapAcceptsPolicies = requires { typename BST::Map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, Policies...>; };
+
+TEST(MapTestSuite, RejectsEquivalentKeys) {
+    constexpr bool accepts_unique_keys = MapAcceptsPolicies<BST::RedBlackBalancing, BST::UniqueKeys>;
+    constexpr bool accepts_equivalent_keys = MapAcceptsPolicies<BST::EquivalentKeys> || MapAcceptsPolicies<BST::RedBlackBalancing, BST::EquivalentKeys>;
+
+    ASSERT_TRUE(accepts_unique_keys && !accepts_equivalent_keys);
+}
+
+struct EventLess {
+    bool operator()(const std::pair<int, int>& lhs, const std::pair<int, int>& rhs) const {
+        return lhs.first < rhs.first;
+    }
+};
+
+TEST(EquivalentKeysTestSuite, KeepsInsertionOrder_InOrderTraversal) {
+    BST::BinarySearchTree<std::pair<int, int>, BST::InOrderTraversal, EventLess, std::allocator<Node<std::pair<int, int>>>, BST::RedBlackBalancing, BST::EquivalentKeys> events;
+    std::multiset<std::pair<int, int>, EventLess> correct_events;
+    for (int i = 0; i < 5000; ++i) {
+        std::pair<int, int> event((i * 7919) % 97, i);
+        events.insert(event);
+        correct_events.insert(event);
+        if (i % 7 == 0) {
+            int erased_time = (i * 31) % 97;
+            std::size_t erased_count = correct_events.erase({erased_time, 0});
+            if (events.erase(std::pair<int, int>(erased_time, -1)) != erased_count) break;
+        }
+    }
+    auto [first, last] = events.equal_range({42, 0});
+    auto [correct_first, correct_last] = correct_events.equal_range({42, 0});
+
+    ASSERT_TRUE(std::equal(events.begin(), events.end(), correct_events.begin(), correct_events.end()) && events.size() == correct_events.size()
+                && std::equal(first, last, correct_first, correct_last) && events.count({42, 0}) == correct_events.count({42, 0})
+                && (*events.find({42, 0})).second == correct_first->second && events.height() <= 2 * std::log2(events.size() + 1));
+}
+
+TEST(EquivalentKeysTestSuite, CountAndEraseAll_PostOrderTraversal) {
+    BST::BinarySearchTree<int, BST::PostOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::EquivalentKeys> bst = {5, 3, 5, 8, 5, 1, 3};
+    BST::BinarySearchTree<int, BST::PostOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::EquivalentKeys> other = {5, 9};
+    bool counted = bst.count(5) == 3 && bst.count(3) == 2 && bst.count(4) == 0 && bst.size() == 7;
+    std::size_t erased = bst.erase(5);
+    bst.merge(other);
+    std::vector<int> keys = bst.TraversalToVector();
+    std::sort(keys.begin(), keys.end());
+    std::vector<int> expected = {1, 3, 3, 5, 8, 9};
+
+    ASSERT_TRUE(counted && erased == 3 && keys == expected && bst.size() == 6 && other.empty()
+                && std::vector<int>(bst.rbegin(), bst.rend()).size() == 6);
+}
+
+TEST(HintedInsertTestSuite, AppendAndPrependWithoutDescent_InOrderTraversal) {
+    constexpr int stream_size = 10000;
+    BST::BinarySearchTree<int, BST::InOrderTraversal, CountingIntLess, std::allocator<Node<int>>, BST::RedBlackBalancing, BST::CollectStatistics> bst;
+    CountingIntLess::comparisons = 0;
+    for (int i = 0; i < stream_size; ++i) {
+        bst.insert(bst.cend(), i);
+        bst.emplace_hint(bst.cbegin(), -i - 1);
+    }
+    BST::TreeStatistics stats = bst.stats();
+    auto duplicate = bst.insert(bst.cbegin(), 5);
+    auto misplaced = bst.insert(bst.find(-7), stream_size * 2);
+    std::vector<int> expected(2 * stream_size);
+    std::iota(expected.begin(), expected.end(), -stream_size);
+    expected.push_back(stream_size * 2);
+
+    ASSERT_TRUE(stats.comparisons == 2 * stream_size - 1 && stats.inserts == 2 * stream_size && stats.max_depth == 1
+                && *duplicate == 5 && *misplaced == stream_size * 2 && std::equal(bst.begin(), bst.end(), expected.begin(), expected.end())
+                && bst.height() <= 2 * std::log2(bst.size() + 1));
+}
+
+TEST(HintedInsertTestSuite, HintsKeepOrderOfEquivalents_PostOrderTraversal) {
+    BST::BinarySearchTree<std::pair<int, int>, BST::PostOrderTraversal, EventLess, std::allocator<Node<std::pair<int, int>>>, BST::EquivalentKeys> events;
+    std::multiset<std::pair<int, int>, EventLess> correct_events;
+    for (int i = 0; i < 2000; ++i) {
+        std::pair<int, int> event((i * 37) % 101, i);
+        auto hint = (i % 3 == 0) ? events.cend() : events.find({(i * 11) % 101, 0});
+        events.insert(hint, event);
+        correct_events.insert(event);
+    }
+    std::vector<std::pair<int, int>> traversal = events.TraversalToVector();
+    std::vector<std::pair<int, int>> iterated(events.begin(), events.end());
+    bool first_equivalents_found = true;
+    for (int key = 0; key < 101; ++key) {
+        first_equivalents_found = first_equivalents_found && *events.find({key, 0}) == *correct_events.find({key, 0})
+                                  && events.count({key, 0}) == correct_events.count({key, 0});
+    }
+
+    ASSERT_TRUE(traversal == iterated && first_equivalents_found && events.size() == correct_events.size());
+}
+
+TEST(BatchLookupTestSuite, FindBatchMatchesFind_PostOrderTraversal) {
+    BST::BinarySearchTree<int, BST::PostOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::AvlBalancing> bst;
+    for (int i = 0; i < 5000; ++i) {
+        bst.insert((i * 7919) % 20011);
+    }
+    std::vector<int> queries = {-5, 0, 3, 3, 7919, 7920, 15000, 20010, 20011, 40000, 17, 2, 20000};
+    std::vector<decltype(bst)::iterator> found(queries.size());
+    std::vector<decltype(bst)::iterator> bounds(queries.size());
+    auto found_end = bst.find_batch(queries.begin(), queries.end(), found.begin());
+    bst.lower_bound_batch(queries.begin(), queries.end(), bounds.data());
+    bool matches = found_end == found.end();
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+        matches = matches && found[i] == bst.find(queries[i]) && bounds[i] == bst.lower_bound(queries[i]);
+    }
+
+    ASSERT_TRUE(matches);
+}
+
+TEST(BatchLookupTestSuite, SortedBatchWalksFromFinger_InOrderTraversal) {
+    constexpr int tree_size = 1 << 16;
+    BST::BinarySearchTree<int, BST::InOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing, BST::CollectStatistics> bst;
+    for (int i = 0; i < tree_size; ++i) {
+        bst.insert(bst.cend(), 2 * i);
+    }
+    std::vector<int> queries(2 * tree_size);
+    std::iota(queries.begin(), queries.end(), 0);
+    std::vector<decltype(bst)::iterator> found(queries.size());
+    bst.reset_stats();
+    bst.find_batch(queries.begin(), queries.end(), found.begin());
+    BST::TreeStatistics stats = bst.stats();
+    bool matches = true;
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+        matches = matches && (i % 2 == 0 ? found[i] != bst.end() && *found[i] == queries[i] : found[i] == bst.end());
+    }
+
+    ASSERT_TRUE(matches && stats.searches == queries.size() && stats.search_visits < 4 * queries.size()
+                && stats.search_visits * 4 < queries.size() * bst.height());
+}
+
+TEST(AllocatorTestSuite, SlabAllocatorTree) {
+    BST::BinarySearchTree<std::string, BST::InOrderTraversal, std::less<std::string>, BST::SlabAllocator<Node<std::string>>, BST::RedBlackBalancing> bst;
+    for (int i = 0; i < 1000; ++i) {
+        bst.insert(std::to_string(i));
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        bst.erase(std::to_string(i));
+    }
+    auto bst_copy = bst;
+
+    ASSERT_TRUE(bst.size() == 500 && bst == bst_copy && bst.get_allocator() == bst.get_allocator() && bst.get_allocator() != bst_copy.get_allocator());
+}
+
+TEST(AllocatorTestSuite, SlabAllocatorReusesReleasedNodes) {
+    BST::BinarySearchTree<int, BST::PreOrderTraversal, std::less<int>, BST::SlabAllocator<Node<int>>> bst = {5, 3, 8};
+    const int* released_address = &*bst.find(3);
+    bst.erase(3);
+    bst.insert(4);
+
+    ASSERT_EQ(&*bst.find(4), released_address);
+}
+
+TEST(AllocatorTestSuite, SlabTreeDropsPoolWithoutWalkOnlyWhenAlone) {
+    using Tree = BST::BinarySearchTree<int, BST::InOrderTraversal, std::less<int>, BST::SlabAllocator<Node<int>>, BST::AvlBalancing>;
+    static_assert(std::is_trivially_destructible_v<Node<int, BST::AvlNodeData>>);
+    BST::SlabAllocator<Node<int>> allocator;
+    Node<int>* block = allocator.allocate(1);
+    bool alone = allocator.owns_all_blocks();
+    bool shared = true;
+    {
+        BST::SlabAllocator<Node<int>> copy = allocator;
+        shared = copy.owns_all_blocks();
+    }
+    allocator.deallocate(block, 1);
+    BST::SlabAllocator<Node<int>> rebound;
+    {
+        BST::SlabAllocator<char> small;
+        char* byte = small.allocate(1);
+        rebound = BST::SlabAllocator<Node<int>>(small);
+        small.deallocate(byte, 1);
+    }
+    bool misfit_alone = rebound.owns_all_blocks();
+    bool moved_from_alone = true;
+    {
+        BST::SlabAllocator<Node<int>> source;
+        BST::SlabAllocator<Node<int>> target = std::move(source);
+        moved_from_alone = source.owns_all_blocks();
+    }
+    Tree::node_type handle;
+    {
+        Tree bst;
+        for (int i = 0; i < 100000; ++i) {
+            bst.insert(i);
+        }
+        handle = bst.extract(500);
+        Tree moved(std::move(bst));
+    }
+    {
+        Tree bst = {1, 2, 3};
+    }
+
+    ASSERT_TRUE(alone && !shared && !misfit_alone && !moved_from_alone && handle.value() == 500);
+}
+
+struct Account {
+    inline static int constructions = 0;
+
+    int id = 0;
+    std::string owner;
+
+    Account() {
+        ++constructions;
+    }
+
+    Account(int account_id, std::string account_owner) : id(account_id), owner(std::move(account_owner)) {
+        ++constructions;
+    }
+
+    Account(const Account& other) : id(other.id), owner(other.owner) {
+        ++constructions;
+    }
+
+    bool operator==(const Account& rhs) const = default;
+};
+
+struct AccountLess {
+    using is_transparent = void;
+
+    bool operator()(const Account& lhs, const Account& rhs) const {
+        return lhs.id < rhs.id;
+    }
+
+    bool operator()(const Account& lhs, int rhs) const {
+        return lhs.id < rhs;
+    }
+
+    bool operator()(int lhs, const Account& rhs) const {
+        return lhs < rhs.id;
+    }
+};
+
+TEST(HeterogeneousLookupTestSuite, StringViewProbes_InOrderTraversal) {
+    BST::BinarySearchTree<std::string, BST::InOrderTraversal, std::less<>> bst = {"apple", "cherry", "banana", "date"};
+    std::string_view existing = "banana", missing = "blueberry";
+
+    ASSERT_TRUE(*bst.find(existing) == "banana" && bst.find(missing) == bst.end() && bst.count(existing) == 1
+                && bst.contains(std::string_view("date")) && *bst.lower_bound(missing) == "cherry"
+                && *bst.upper_bound(existing) == "cherry");
+}
+
+TEST(HeterogeneousLookupTestSuite, StringViewEraseAndExtract_PreOrderTraversal) {
+    BST::BinarySearchTree<std::string, BST::PreOrderTraversal, std::less<>> bst = {"b", "a", "c"};
+    auto erased = bst.erase(std::string_view("a"));
+    auto element = bst.extract(std::string_view("c"));
+    std::vector<std::string> correct_traversal = {"b"};
+
+    ASSERT_TRUE(erased == 1 && element.value() == "c" && bst.TraversalToVector() == correct_traversal);
+}
+
+TEST(HeterogeneousLookupTestSuite, ProbesDoNotConstructKeys_PostOrderTraversal) {
+    BST::BinarySearchTree<Account, BST::PostOrderTraversal, AccountLess> bst;
+    bst.insert(Account(3, "carol"));
+    bst.insert(Account(1, "alice"));
+    bst.insert(Account(2, "bob"));
+    int constructions_before = Account::constructions;
+    bool found = (*bst.find(2)).owner == "bob" && bst.contains(1) && !bst.contains(4) && (*bst.lower_bound(2)).id == 2
+                 && (*bst.upper_bound(2)).id == 3 && bst.count(3) == 1;
+
+    ASSERT_TRUE(found && Account::constructions == constructions_before);
+}
+
+TEST(BulkBuildTestSuite, SortedRangeBuildsBalancedTree_InOrderTraversal) {
+    std::vector<int> values((1 << 20) - 1);
+    std::iota(values.begin(), values.end(), 0);
+    BST::BinarySearchTree<int, BST::InOrderTraversal> bst(values.begin(), values.end());
+
+    ASSERT_TRUE(bst.size() == values.size() && bst.height() == 20 && bst.TraversalToVector() == values);
+}
+
+TEST(BulkBuildTestSuite, SortedUniqueTag_PreOrderTraversal) {
+    BST::BinarySearchTree<int, BST::PreOrderTraversal> bst(BST::sorted_unique, {1, 2, 3, 4, 5, 6, 7});
+    std::vector<int> expected = {4, 2, 1, 3, 6, 5, 7};
+
+    ASSERT_TRUE(bst.TraversalToVector() == expected);
+}
+
+TEST(BulkBuildTestSuite, UnsortedRangeFallsBack_PostOrderTraversal) {
+    std::vector<int> values = {5, 3, 8, 3, 1};
+    BST::BinarySearchTree<int, BST::PostOrderTraversal> bst(values.begin(), values.end());
+    std::vector<int> expected = {1, 3, 8, 5};
+
+    ASSERT_TRUE(bst.size() == 4 && bst.TraversalToVector() == expected);
+}
+
+TEST(BulkBuildTestSuite, SortedListKeepsInsertionShape_PreAndPostOrderTraversal) {
+    BST::BinarySearchTree<int, BST::PreOrderTraversal> pre_order = {1, 2, 3, 4, 5};
+    BST::BinarySearchTree<int, BST::PostOrderTraversal> post_order = {1, 2, 3};
+    BST::BinarySearchTree<int, BST::PreOrderTraversal> pre_order_one_by_one;
+    BST::BinarySearchTree<int, BST::PostOrderTraversal> post_order_one_by_one;
+    for (int i = 1; i <= 5; ++i) {
+        pre_order_one_by_one.insert(i);
+        if (i <= 3) post_order_one_by_one.insert(i);
+    }
+    std::vector<int> expected_post_order = {3, 2, 1};
+
+    ASSERT_TRUE(pre_order == pre_order_one_by_one && post_order == post_order_one_by_one
+                && post_order.TraversalToVector() == expected_post_order);
+}
+
+TEST(BulkBuildTestSuite, SortedUniqueAppendsToNonEmptyTree_InOrderTraversal) {
+    BST::BinarySearchTree<int, BST::InOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing, BST::CollectStatistics> bst;
+    for (int i = 0; i < 1000; i += 2) {
+        bst.insert(i);
+    }
+    std::vector<int> appended(1000);
+    std::iota(appended.begin(), appended.end(), 1000);
+    std::vector<int> interleaved = {-1, 1, 3, 501, 997, 999, 5000};
+    bst.reset_stats();
+    bst.insert(BST::sorted_unique, appended.begin(), appended.end());
+    BST::TreeStatistics stats = bst.stats();
+    bst.insert(BST::sorted_unique, interleaved.begin(), interleaved.end());
+    std::vector<int> expected = {-1};
+    for (int i = 0; i < 1000; i += 2) {
+        expected.push_back(i);
+        if (i == 0 || i == 2 || i == 500 || i == 996 || i == 998) expected.push_back(i + 1);
+    }
+    expected.insert(expected.end(), appended.begin(), appended.end());
+    expected.push_back(5000);
+
+    ASSERT_TRUE(stats.comparisons == appended.size() && bst.TraversalToVector() == expected
+                && bst.height() <= 2 * std::log2(bst.size() + 1));
+}
+
+TEST(BulkBuildTestSuite, RedBlackStaysValidAfterBulkBuild_InOrderTraversal) {
+    std::vector<int> values(1000);
+    std::iota(values.begin(), values.end(), 0);
+    BST::BinarySearchTree<int, BST::InOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing> bst;
+    bst.insert(BST::sorted_unique, values.begin(), values.end());
+    for (int i = 0; i < 1000; i += 2) {
+        bst.erase(i);
+    }
+    for (int i = 1000; i < 3000; ++i) {
+        bst.insert(i);
+    }
+    std::vector<int> expected;
+    for (int i = 1; i < 1000; i += 2) {
+        expected.push_back(i);
+    }
+    for (int i = 1000; i < 3000; ++i) {
+        expected.push_back(i);
+    }
+
+    ASSERT_TRUE(bst.TraversalToVector() == expected && bst.height() <= 2 * std::log2(bst.size() + 1));
+}
+
+// Runs the body on a thread with a fixed stack, so recursion proportional to the tree height would overflow it
+template<typename Function>
+void RunWithStackSize(std::size_t stack_size, Function function) {
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, stack_size);
+    pthread_t thread;
+    pthread_create(&thread, &attributes, [](void* argument) -> void* {
+        (*static_cast<Function*>(argument))();
+        return nullptr;
+    }, &function);
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attributes);
+}
+
+// Appending through the end() hint is O(1), so the fully skewed tree builds in linear time
+TEST(DeepTreeTestSuite, CopyAndDestroySkewedTree_InOrderTraversal) {
+    constexpr int tree_size = 10000000;
+    bool copied = false;
+
+    RunWithStackSize(8 * 1024 * 1024, [&copied]() {
+        auto bst = std::make_unique<BST::BinarySearchTree<int, BST::InOrderTraversal>>();
+        for (int i = 1; i <= tree_size; ++i) {
+            bst->insert(bst->cend(), i);
+        }
+        auto bst_copy = std::make_unique<BST::BinarySearchTree<int, BST::InOrderTraversal>>(*bst);
+        copied = bst_copy->height() == tree_size && *bst_copy == *bst;
+        bst.reset();
+        bst_copy->clear();
+        copied = copied && bst_copy->empty();
+    });
+
+    ASSERT_TRUE(copied);
+}
+
+// Copies throw once the budget runs out, live counts the instances that were built and not destroyed
+struct ThrowingKey {
+    inline static std::atomic<int> live = 0;
+    inline static std::atomic<int> copies_left = -1;
+    int value = 0;
+
+    ThrowingKey() { ++live; }
+    ThrowingKey(int key_value) : value(key_value) { ++live; }
+    ThrowingKey(const ThrowingKey& other) : value(other.value) {
+        int budget = copies_left.load();
+        while (budget != -1 && !copies_left.compare_exchange_weak(budget, budget - 1)) {}
+        if (budget == 0) {
+            copies_left = 0;
+            throw std::runtime_error("Copy failed");
+        }
+        ++live;
+    }
+    ~ThrowingKey() { --live; }
+
+    bool operator==(const ThrowingKey& rhs) const { return value == rhs.value; }
+    bool operator<(const ThrowingKey& rhs) const { return value < rhs.value; }
+};
+
+TEST(ExceptionSafetyTestSuite, FailedCopiesAndBuildsFreeTheirNodes_InOrderTraversal) {
+    using Tree = BST::BinarySearchTree<ThrowingKey, BST::InOrderTraversal, std::less<ThrowingKey>, std::allocator<Node<ThrowingKey>>, BST::AvlBalancing>;
+    std::vector<ThrowingKey> keys;
+    for (int i = 0; i < 1000; ++i) {
+        keys.emplace_back(i);
+    }
+    Tree bst(BST::sorted_unique, keys.begin(), keys.end());
+    BST::TaskPool pool(4);
+    int live_before = ThrowingKey::live;
+    auto fails_cleanly = [live_before](auto make) {
+        ThrowingKey::copies_left = 500;
+        bool thrown = false;
+        try {
+            make();
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        ThrowingKey::copies_left = -1;
+
+        return thrown && ThrowingKey::live == live_before;
+    };
+    bool cleaned = fails_cleanly([&bst] { Tree copy(bst); })
+                   && fails_cleanly([&keys] { Tree built(BST::sorted_unique, keys.begin(), keys.end()); })
+                   && fails_cleanly([&pool, &bst] { Tree copy = BST::parallel_copy(pool, bst); });
+    Tree copy(bst);
+
+    ASSERT_TRUE(cleaned && copy == bst && ThrowingKey::live == live_before + 1001);
+}
+
+template<typename TraversalTag>
+using OrderStatisticsTree = BST::BinarySearchTree<int, TraversalTag, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing, BST::OrderStatistics>;
+
+TEST(OrderStatisticsTestSuite, RankSelectAndCountRange_InOrderTraversal) {
+    OrderStatisticsTree<BST::InOrderTraversal> bst;
+    for (int i = 100; i > 0; --i) {
+        bst.insert(i * 10);
+    }
+    for (int i = 1; i <= 100; i += 2) {
+        bst.erase(i * 10);
+    }
+
+    ASSERT_TRUE(bst.rank(20) == 0 && bst.rank(25) == 1 && bst.rank(2000) == 50 && *bst.select(0) == 20
+                && *bst.select(49) == 1000 && bst.select(50) == bst.end() && bst.count_range(100, 201) == 6
+                && bst.count_range(500, 100) == 0);
+}
+
+TEST(OrderStatisticsTestSuite, DistanceAndAdvance_PreOrderTraversal) {
+    OrderStatisticsTree<BST::PreOrderTraversal> bst = {5, 3, 8, 1, 4, 7, 9};
+    auto it = bst.begin();
+    bst.advance(it, 4);
+    auto it_end = bst.begin();
+    bst.advance(it_end, 7);
+
+    ASSERT_TRUE(*it == *std::next(bst.begin(), 4) && bst.distance(bst.begin(), it) == 4
+                && it_end == bst.end() && bst.distance(it_end, bst.begin()) == -7);
+}
+
+TEST(OrderStatisticsTestSuite, DistanceAfterErase_PostOrderTraversal) {
+    OrderStatisticsTree<BST::PostOrderTraversal> bst;
+    for (int i = 0; i < 1000; ++i) {
+        bst.insert((i * 7919) % 1000);
+    }
+    bst.erase(bst.cbegin(), std::next(bst.cbegin(), 500));
+    auto middle = std::next(bst.cbegin(), 123);
+
+    ASSERT_TRUE(bst.size() == 500 && bst.distance(bst.cbegin(), middle) == 123 && bst.distance(bst.cbegin(), bst.cend()) == 500);
+}
+
+TEST(FrozenTestSuite, MatchesLinkedTreeLookups_InOrderTraversal) {
+    BST::BinarySearchTree<int, BST::InOrderTraversal> bst;
+    for (int i = 0; i < 1000; ++i) {
+        bst.insert((i * 7919) % 3000);
+    }
+    BST::FrozenBinarySearchTree<int> frozen(bst);
+    bool same_answers = true;
+    for (int key = -5; key < 3005; ++key) {
+        same_answers = same_answers && bst.contains(key) == frozen.contains(key)
+                       && (bst.lower_bound(key) == bst.end() ? frozen.lower_bound(key) == frozen.end() : *bst.lower_bound(key) == *frozen.lower_bound(key))
+                       && (bst.upper_bound(key) == bst.end() ? frozen.upper_bound(key) == frozen.end() : *bst.upper_bound(key) == *frozen.upper_bound(key));
+    }
+
+    ASSERT_TRUE(same_answers && frozen.size() == 1000 && std::vector<int>(frozen.begin(), frozen.end()) == bst.TraversalToVector());
+}
+
+TEST(FrozenTestSuite, IteratesInKeyOrder_PostOrderTraversal) {
+    BST::BinarySearchTree<std::string, BST::PostOrderTraversal> bst = {"m", "c", "x", "a", "e", "q"};
+    BST::FrozenBinarySearchTree<std::string> frozen(bst);
+    std::vector<std::string> correct_order = {"a", "c", "e", "m", "q", "x"};
+    std::vector<std::string> reverse_order(frozen.rbegin(), frozen.rend());
+    std::reverse(reverse_order.begin(), reverse_order.end());
+
+    ASSERT_TRUE(std::vector<std::string>(frozen.begin(), frozen.end()) == correct_order && reverse_order == correct_order
+                && *frozen.find("e") == "e" && frozen.find("b") == frozen.end());
+}
+
+TEST(FrozenTestSuite, EmptyTree_PreOrderTraversal) {
+    BST::BinarySearchTree<int, BST::PreOrderTraversal> bst;
+    BST::FrozenBinarySearchTree<int> frozen(bst);
+
+    ASSERT_TRUE(frozen.empty() && frozen.begin() == frozen.end() && frozen.find(1) == frozen.end() && frozen.lower_bound(1) == frozen.end());
+}
+
+TEST(FrozenTestSuite, FailedBuildsAndCopiesFreeTheirKeys) {
+    BST::BinarySearchTree<ThrowingKey, BST::InOrderTraversal> in_order;
+    BST::BinarySearchTree<ThrowingKey, BST::PreOrderTraversal> pre_order;
+    for (int i = 0; i < 1000; ++i) {
+        in_order.insert((i * 7919) % 1000);
+        pre_order.insert((i * 7919) % 1000);
+    }
+    BST::FrozenBinarySearchTree<ThrowingKey> frozen(in_order);
+    int live_before = ThrowingKey::live;
+    auto fails_cleanly = [live_before](int copies, auto make) {
+        ThrowingKey::copies_left = copies;
+        bool thrown = false;
+        try {
+            make();
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        ThrowingKey::copies_left = -1;
+
+        return thrown && ThrowingKey::live == live_before;
+    };
+    bool cleaned = fails_cleanly(149, [&in_order] { BST::FrozenBinarySearchTree<ThrowingKey> built(in_order); })
+                   && fails_cleanly(149, [&pre_order] { BST::FrozenBinarySearchTree<ThrowingKey> built(pre_order); })
+                   && fails_cleanly(1500, [&pre_order] { BST::FrozenBinarySearchTree<ThrowingKey> built(pre_order); })
+                   && fails_cleanly(149, [&frozen] { BST::FrozenBinarySearchTree<ThrowingKey> copy(frozen); });
+
+    ASSERT_TRUE(cleaned && std::equal(frozen.begin(), frozen.end(), in_order.begin(), in_order.end()));
+}
+
+template<typename Key>
+bool MatchesStdSetUnderChurn(std::size_t operations) {
+    BST::BPlusTree<Key> tree;
+    std::set<Key> reference;
+    std::uint64_t state = 88172645463325252ULL;
+    bool same_answers = true;
+    for (std::size_t i = 0; i < operations; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        Key key = static_cast<Key>(static_cast<std::int64_t>(state % 4000) - 2000);
+        if (state % 3 == 0) {
+            same_answers = same_answers && tree.erase(key) == reference.erase(key);
+        } else {
+            same_answers = same_answers && tree.insert(key).second == reference.insert(key).second;
+        }
+        auto lower = reference.lower_bound(key);
+        same_answers = same_answers && tree.contains(key) == reference.contains(key)
+                       && (lower == reference.end() ? tree.lower_bound(key) == tree.end() : *tree.lower_bound(key) == *lower);
+    }
+
+    return same_answers && tree.size() == reference.size() && std::equal(tree.begin(), tree.end(), reference.begin(), reference.end())
+           && std::equal(tree.rbegin(), tree.rend(), reference.rbegin(), reference.rend());
+}
+
+TEST(BPlusTreeTestSuite, MatchesStdSet_Int) {
+    ASSERT_TRUE(MatchesStdSetUnderChurn<int>(200000));
+}
+
+TEST(BPlusTreeTestSuite, MatchesStdSet_Int64) {
+    ASSERT_TRUE(MatchesStdSetUnderChurn<std::int64_t>(200000));
+}
+
+TEST(BPlusTreeTestSuite, MatchesStdSet_Double) {
+    ASSERT_TRUE(MatchesStdSetUnderChurn<double>(200000));
+}
+
+TEST(BPlusTreeTestSuite, StringKeysAndCopies) {
+    BST::BPlusTree<std::string> tree;
+    for (int i = 0; i < 2000; ++i) {
+        tree.insert(std::to_string(i));
+    }
+    for (int i = 0; i < 2000; i += 2) {
+        tree.erase(std::to_string(i));
+    }
+    BST::BPlusTree<std::string> copy = tree;
+    copy.erase(copy.find("1"));
+
+    ASSERT_TRUE(tree.size() == 1000 && copy.size() == 999 && tree != copy && *tree.begin() == "1" && *copy.begin() == "1001"
+                && *tree.upper_bound("1998") == "1999" && *tree.upper_bound("1999") == "201" && tree.upper_bound("999") == tree.end() && !tree.contains("10"));
+}
+
+TEST(BPlusTreeTestSuite, EraseDownToEmpty) {
+    BST::BPlusTree<int> tree;
+    for (int i = 0; i < 10000; ++i) {
+        tree.insert(i);
+    }
+    auto it = tree.begin();
+    while (it != tree.end()) {
+        it = tree.erase(it);
+    }
+    tree.insert(42);
+
+    ASSERT_TRUE(tree.size() == 1 && *tree.begin() == 42 && *std::prev(tree.end()) == 42);
+}
+
+TEST(BPlusTreeTestSuite, OrderedSetSelectsNodeLayout) {
+    ASSERT_TRUE((std::is_same_v<BST::OrderedSet<int>, BST::BPlusTree<int>>
+                 && !std::is_same_v<BST::OrderedSet<std::string>, BST::BPlusTree<std::string>>
+                 && !std::is_same_v<BST::OrderedSet<int, std::greater<int>>, BST::BPlusTree<int, std::greater<int>>>));
+}
+
+TEST(ConcurrentTestSuite, MatchesStdSet) {
+    BST::ConcurrentBinarySearchTree<int> tree;
+    std::set<int> reference;
+    bool same_answers = true;
+    for (int i = 0; i < 20000; ++i) {
+        int key = (i * 7919) % 5000;
+        if (i % 3 == 0) {
+            same_answers = same_answers && tree.erase(key) == reference.erase(key);
+        } else {
+            same_answers = same_answers && tree.insert(key) == reference.insert(key).second;
+        }
+        auto lower = reference.lower_bound(key + 1);
+        same_answers = same_answers && tree.contains(key) == reference.contains(key)
+                       && (lower == reference.end() ? !tree.lower_bound(key + 1) : tree.lower_bound(key + 1) == *lower);
+    }
+
+    ASSERT_TRUE(same_answers && tree.size() == reference.size());
+}
+
+TEST(ConcurrentTestSuite, ThrowingWritesLeaveTreeUnchanged) {
+    int live_before = ThrowingKey::live;
+    bool unchanged = true;
+    {
+        BST::ConcurrentBinarySearchTree<ThrowingKey> tree;
+        std::set<int> reference;
+        for (int i = 0; i < 20000; ++i) {
+            int key = (i * 7919) % 3000;
+            ThrowingKey::copies_left = i % 7;
+            try {
+                if (i % 3 == 0) {
+                    tree.erase(key);
+                    reference.erase(key);
+                } else {
+                    tree.insert(key);
+                    reference.insert(key);
+                }
+            } catch (const std::runtime_error&) {
+            }
+            ThrowingKey::copies_left = -1;
+            unchanged = unchanged && tree.contains(key) == reference.contains(key) && tree.size() == reference.size();
+        }
+        auto snapshot = tree.snapshot();
+        unchanged = unchanged && std::equal(snapshot.begin(), snapshot.end(), reference.begin(), reference.end(),
+                                            [](const ThrowingKey& lhs, int rhs) { return lhs.value == rhs; });
+    }
+
+    ASSERT_TRUE(unchanged && ThrowingKey::live == live_before);
+}
+
+// Even keys stay in the tree while the writers churn the odd ones, so every reader must keep finding
+// them. Build with BST_SANITIZE_THREAD=ON to run this under ThreadSanitizer
+TEST(ConcurrentTestSuite, ReadersRunAlongsideWriters) {
+    constexpr int kKeys = 2000;
+    BST::ConcurrentBinarySearchTree<int> tree;
+    for (int key = 0; key < kKeys; key += 2) {
+        tree.insert(key);
+    }
+
+    std::atomic<bool> stop = false;
+    std::atomic<bool> readers_ok = true;
+    std::vector<std::thread> threads;
+    for (int reader = 0; reader < 6; ++reader) {
+        threads.emplace_back([&, reader] {
+            for (int key = reader; !stop.load(); key = (key + 7) % (kKeys - 1)) {
+                int even_key = key & ~1;
+                std::optional<int> bound = tree.lower_bound(key);
+                if (!tree.contains(even_key) || tree.find(even_key) != even_key || !bound || *bound < key || *bound > even_key + 2) {
+                    readers_ok.store(false);
+                }
+            }
+        });
+    }
+    for (int writer = 0; writer < 2; ++writer) {
+        threads.emplace_back([&, writer] {
+            for (int round = 0; round < 20; ++round) {
+                for (int key = 1 + 2 * writer; key < kKeys; key += 4) {
+                    tree.insert(key);
+                }
+                for (int key = 1 + 2 * writer; key < kKeys; key += 4) {
+                    tree.erase(key);
+                }
+            }
+        });
+    }
+    threads[6].join();
+    threads[7].join();
+    stop.store(true);
+    for (int reader = 0; reader < 6; ++reader) {
+        threads[reader].join();
+    }
+
+    ASSERT_TRUE(readers_ok.load() && tree.size() == kKeys / 2 && !tree.contains(1) && tree.contains(kKeys - 2));
+}
+
+TEST(ConcurrentTestSuite, SnapshotOutlivesErases) {
+    BST::ConcurrentBinarySearchTree<int> tree;
+    for (int key = 0; key < 5000; ++key) {
+        tree.insert(key);
+    }
+    auto snapshot = tree.snapshot();
+    for (int key = 0; key < 5000; ++key) {
+        tree.erase(key);
+    }
+    tree.insert(-1);
+    std::vector<int> scanned(snapshot.begin(), snapshot.end());
+    std::vector<int> correct_order(5000);
+    std::iota(correct_order.begin(), correct_order.end(), 0);
+
+    ASSERT_TRUE(scanned == correct_order && tree.size() == 1 && *tree.snapshot().begin() == -1);
+}
+
+TEST(ConcurrentTestSuite, ScansRunAlongsideErases) {
+    constexpr int kKeys = 4000;
+    BST::ConcurrentBinarySearchTree<int> tree;
+    for (int key = 0; key < kKeys; ++key) {
+        tree.insert(key);
+    }
+
+    std::atomic<bool> stop = false;
+    std::atomic<bool> scans_ok = true;
+    std::thread scanner([&] {
+        while (!stop.load()) {
+            auto snapshot = tree.snapshot();
+            int previous = -1;
+            int even_keys = 0;
+            for (int key : snapshot) {
+                even_keys += (key % 2 == 0);
+                if (key <= previous) {
+                    scans_ok.store(false);
+                }
+                previous = key;
+            }
+            if (even_keys != kKeys / 2) {
+                scans_ok.store(false);
+            }
+        }
+    });
+    for (int round = 0; round < 10; ++round) {
+        for (int key = 1; key < kKeys; key += 2) {
+            tree.erase(key);
+        }
+        for (int key = 1; key < kKeys; key += 2) {
+            tree.insert(key);
+        }
+    }
+    stop.store(true);
+    scanner.join();
+
+    ASSERT_TRUE(scans_ok.load() && tree.size() == kKeys);
+}
+
+TEST(ParallelTestSuite, CopyKeepsShapeAndData_PostOrderTraversal) {
+    BST::TaskPool pool(4);
+    BST::BinarySearchTree<int, BST::PostOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::AvlBalancing> bst;
+    for (int i = 0; i < 20000; ++i) {
+        bst.insert((i * 7919) % 30000);
+    }
+    auto copy = BST::parallel_copy(pool, bst);
+    copy.insert(-1);
+    copy.erase(copy.cbegin());
+
+    ASSERT_TRUE(copy.size() == bst.size() + 1 - 1 && copy.height() == bst.height() && copy.TraversalToVector().size() == bst.size());
+}
+
+TEST(ParallelTestSuite, SetOperationsMatchStdAlgorithms_InOrderTraversal) {
+    BST::TaskPool pool(4);
+    BST::BinarySearchTree<int, BST::InOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing> lhs;
+    BST::BinarySearchTree<int, BST::InOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing> rhs;
+    for (int i = 0; i < 30000; ++i) {
+        lhs.insert((i * 7919) % 50000);
+        rhs.insert(static_cast<int>((i * 104729LL) % 70000));
+    }
+    std::vector<int> lhs_keys = lhs.TraversalToVector();
+    std::vector<int> rhs_keys = rhs.TraversalToVector();
+    std::vector<int> expected_union;
+    std::vector<int> expected_intersection;
+    std::vector<int> expected_difference;
+    std::set_union(lhs_keys.begin(), lhs_keys.end(), rhs_keys.begin(), rhs_keys.end(), std::back_inserter(expected_union));
+    std::set_intersection(lhs_keys.begin(), lhs_keys.end(), rhs_keys.begin(), rhs_keys.end(), std::back_inserter(expected_intersection));
+    std::set_difference(lhs_keys.begin(), lhs_keys.end(), rhs_keys.begin(), rhs_keys.end(), std::back_inserter(expected_difference));
+    auto united = BST::parallel_union(pool, lhs, rhs);
+    united.insert(-5);
+
+    ASSERT_TRUE(BST::parallel_intersection(pool, lhs, rhs).TraversalToVector() == expected_intersection
+                && BST::parallel_difference(pool, lhs, rhs).TraversalToVector() == expected_difference
+                && united.size() == expected_union.size() + 1 && *united.begin() == -5
+                && std::equal(std::next(united.begin()), united.end(), expected_union.begin(), expected_union.end()));
+}
+
+TEST(ParallelTestSuite, JoinBasedAndFlattenedResultsAgree_PreOrderTraversal) {
+    using AvlTree = BST::BinarySearchTree<int, BST::PreOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::AvlBalancing,
+                                          BST::OrderStatistics, BST::CollectStatistics>;
+    using PlainTree = BST::BinarySearchTree<int, BST::PreOrderTraversal>;
+    BST::TaskPool pool(4);
+    AvlTree lhs;
+    AvlTree rhs;
+    PlainTree plain_lhs;
+    PlainTree plain_rhs;
+    for (int i = 0; i < 20000; ++i) {
+        int lhs_key = (i * 7919) % 30011;
+        int rhs_key = (i * 104729) % 40009;
+        lhs.insert(lhs_key);
+        rhs.insert(rhs_key);
+        plain_lhs.insert(lhs_key);
+        plain_rhs.insert(rhs_key);
+    }
+    auto intersection = BST::parallel_intersection(pool, lhs, rhs);
+    auto difference = BST::parallel_difference(pool, lhs, rhs);
+    std::vector<int> intersection_keys(intersection.begin(), intersection.end());
+    std::vector<int> plain_intersection_keys = BST::parallel_intersection(pool, plain_lhs, plain_rhs).TraversalToVector();
+    std::sort(intersection_keys.begin(), intersection_keys.end());
+    std::sort(plain_intersection_keys.begin(), plain_intersection_keys.end());
+    std::vector<int> difference_keys(difference.begin(), difference.end());
+    std::sort(difference_keys.begin(), difference_keys.end());
+    BST::TreeStatistics stats = intersection.stats();
+
+    ASSERT_TRUE(intersection_keys == plain_intersection_keys && intersection.size() == intersection_keys.size()
+                && stats.allocations - stats.deallocations == intersection.size() + 1
+                && difference.size() + intersection.size() == lhs.size() && *difference.select(0) == difference_keys.front()
+                && *difference.select(difference.size() / 2) == difference_keys[difference.size() / 2]
+                && difference.rank(difference_keys.back()) == difference.size() - 1);
+}
+
+TEST(ParallelTestSuite, ForEachVisitsEveryKeyOnce_PreOrderTraversal) {
+    BST::TaskPool pool(3);
+    BST::BinarySearchTree<long long, BST::PreOrderTraversal> bst;
+    for (long long i = 0; i < 10000; ++i) {
+        bst.insert((i * 7919) % 10000);
+    }
+    std::atomic<long long> sum = 0;
+    std::atomic<int> visits = 0;
+    BST::parallel_for_each(pool, bst, [&](long long key_value) {
+        sum.fetch_add(key_value);
+        visits.fetch_add(1);
+    });
+
+    ASSERT_TRUE(visits.load() == 10000 && sum.load() == 10000LL * 9999 / 2);
+}
+
+TEST(ParallelTestSuite, BuildMatchesSortedConstructor_PreOrderTraversal) {
+    using Tree = BST::BinarySearchTree<int, BST::PreOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::RedBlackBalancing>;
+    BST::TaskPool pool(4);
+    std::vector<int> keys(40000);
+    std::iota(keys.begin(), keys.end(), 0);
+    Tree sequential(BST::sorted_unique, keys.begin(), keys.end());
+    Tree parallel = BST::parallel_build<Tree>(pool, BST::sorted_unique, keys.begin(), keys.end());
+    Tree empty = BST::parallel_build<Tree>(pool, BST::sorted_unique, keys.begin(), keys.begin());
+    parallel.insert(-1);
+    parallel.erase(-1);
+
+    ASSERT_TRUE(parallel.TraversalToVector() == sequential.TraversalToVector() && parallel.height() == sequential.height()
+                && empty.empty() && empty.begin() == empty.end());
+}
+
+TEST(ParallelTestSuite, ForEachOverRangeMatchesSequentialWalk_InOrderTraversal) {
+    BST::TaskPool pool(4);
+    BST::BinarySearchTree<long long, BST::InOrderTraversal, std::less<long long>, std::allocator<Node<long long>>, BST::AvlBalancing> bst;
+    for (long long i = 0; i < 5000; ++i) {
+        bst.insert((i * 7919) % 5000);
+    }
+    bool all_match = true;
+    for (long long low = 0; low <= 5000; low += 397) {
+        for (long long high = low; high <= 5000; high += 611) {
+            auto first = bst.lower_bound(low);
+            auto last = bst.lower_bound(high);
+            std::atomic<long long> sum = 0;
+            std::atomic<long long> visits = 0;
+            BST::parallel_for_each(pool, bst, first, last, [&](long long key_value) {
+                sum.fetch_add(key_value);
+                visits.fetch_add(1);
+            });
+            all_match = all_match && visits.load() == high - low && sum.load() == (high - low) * (low + high - 1) / 2;
+        }
+    }
+    std::atomic<long long> whole = 0;
+    BST::parallel_for_each(pool, bst, bst.cbegin(), bst.cend(), [&](long long key_value) { whole.fetch_add(key_value); });
+
+    ASSERT_TRUE(all_match && whole.load() == 5000LL * 4999 / 2);
+}
+
+TEST(ParallelTestSuite, FailedFlattenDestroysCopiedKeys_InOrderTraversal) {
+    using Tree = BST::BinarySearchTree<ThrowingKey, BST::InOrderTraversal>;
+    BST::TaskPool pool(4);
+    int live_before = ThrowingKey::live.load();
+    bool threw_every_time = true;
+    {
+        Tree lhs;
+        Tree rhs;
+        for (int i = 0; i < 4000; ++i) {
+            lhs.insert(ThrowingKey((i * 7919) % 6007));
+            rhs.insert(ThrowingKey((i * 104729) % 8009));
+        }
+        for (int budget : {0, 1, 100, 3000, 5000, 7000, 9000, 11000, 15000}) {
+            ThrowingKey::copies_left = budget;
+            try {
+                auto united = BST::parallel_union(pool, lhs, rhs);
+                threw_every_time = false;
+            } catch (const std::runtime_error&) {}
+            ThrowingKey::copies_left = -1;
+        }
+    }
+
+    ASSERT_TRUE(threw_every_time && ThrowingKey::live.load() == live_before);
+}
+
+TEST(PersistenceTestSuite, LoadWithPoolMatchesSequentialLoad_InOrderTraversal) {
+    using Tree = BST::BinarySearchTree<long long, BST::InOrderTraversal, std::less<long long>, std::allocator<Node<long long>>, BST::AvlBalancing>;
+    BST::TaskPool pool(4);
+    Tree bst;
+    for (long long i = 0; i < 50000; ++i) {
+        bst.insert((i * 7919) % 100003);
+    }
+    auto path = std::filesystem::temp_directory_path() / "bst_tests_parallel_load.snapshot";
+    BST::save(bst, path);
+    auto sequential = BST::load<Tree>(path);
+    auto parallel = BST::load<Tree>(pool, path);
+    std::filesystem::remove(path);
+    parallel.insert(-1);
+    parallel.erase(-1);
+
+    ASSERT_TRUE(parallel.TraversalToVector() == sequential.TraversalToVector() && parallel.height() == sequential.height()
+                && parallel.size() == bst.size());
+}
+
+TEST(PersistenceTestSuite, SaveAndLoadRoundTrip_PostOrderTraversal) {
+    using Tree = BST::BinarySearchTree<long long, BST::PostOrderTraversal, std::less<long long>, std::allocator<Node<long long>>, BST::RedBlackBalancing>;
+    Tree bst;
+    for (long long i = 0; i < 50000; ++i) {
+        bst.insert((i * 7919) % 100003);
+    }
+    auto path = std::filesystem::temp_directory_path() / "bst_tests_round_trip.snapshot";
+    BST::save(bst, path);
+    auto loaded = BST::load<Tree>(path);
+    loaded.insert(-1);
+    loaded.erase(-1);
+    std::filesystem::remove(path);
+    std::vector<long long> keys = bst.TraversalToVector();
+    std::vector<long long> loaded_keys = loaded.TraversalToVector();
+    std::sort(keys.begin(), keys.end());
+    std::sort(loaded_keys.begin(), loaded_keys.end());
+
+    ASSERT_TRUE(loaded_keys == keys && loaded.size() == bst.size() && loaded.height() <= std::log2(loaded.size()) + 1);
+}
+
+TEST(PersistenceTestSuite, MappedSnapshotLookups_InOrderTraversal) {
+    BST::BinarySearchTree<int, BST::InOrderTraversal> bst;
+    for (int i = 0; i < 1000; ++i) {
+        bst.insert((i * 7919) % 3000);
+    }
+    auto path = std::filesystem::temp_directory_path() / "bst_tests_mapped.snapshot";
+    BST::save(bst, path);
+    bool lookups_match = true;
+    {
+        BST::MappedSnapshot<int> snapshot(path);
+        lookups_match = snapshot.verify() && snapshot.size() == bst.size() && std::equal(snapshot.begin(), snapshot.end(), bst.begin(), bst.end());
+        for (int key = -1; key <= 3000; ++key) {
+            auto bound = bst.lower_bound(key);
+            auto mapped_bound = snapshot.lower_bound(key);
+            lookups_match = lookups_match && snapshot.contains(key) == bst.contains(key)
+                            && (bound == bst.end() ? mapped_bound == snapshot.end() : *mapped_bound == *bound);
+        }
+    }
+    std::filesystem::remove(path);
+
+    ASSERT_TRUE(lookups_match);
+}
+
+TEST(PersistenceTestSuite, RejectsCorruptedAndIncompatibleFiles) {
+    BST::BinarySearchTree<int, BST::PreOrderTraversal> bst = {5, 1, 9, 3};
+    auto path = std::filesystem::temp_directory_path() / "bst_tests_corrupted.snapshot";
+    BST::save(bst, path);
+    auto rejects = [&path](auto open) {
+        try {
+            open();
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    bool wrong_key_rejected = rejects([&path] { BST::MappedSnapshot<long long> snapshot(path); });
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(sizeof(BST::SnapshotHeader) + 2);
+        file.put('\x7f');
+    }
+    bool corruption_rejected = rejects([&path] { BST::load<BST::BinarySearchTree<int, BST::PreOrderTraversal>>(path); });
+    std::filesystem::resize_file(path, sizeof(BST::SnapshotHeader) + 3);
+    bool truncation_rejected = rejects([&path] { BST::MappedSnapshot<int> snapshot(path); });
+    std::filesystem::remove(path);
+
+    ASSERT_TRUE(wrong_key_rejected && corruption_rejected && truncation_rejected);
+}
+
+TEST(PersistenceTestSuite, RejectsKeysOutOfOrderForTree) {
+    using Tree = BST::BinarySearchTree<int, BST::InOrderTraversal>;
+    using MultiTree = BST::BinarySearchTree<int, BST::InOrderTraversal, std::less<int>, std::allocator<Node<int>>, BST::EquivalentKeys>;
+    auto path = std::filesystem::temp_directory_path() / "bst_tests_out_of_order.snapshot";
+    auto rejects = [&path](auto open) {
+        try {
+            open();
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    BST::save(BST::BinarySearchTree<int, BST::InOrderTraversal, std::greater<int>>{1, 2, 3}, path);
+    bool reversed_rejected = rejects([&path] { BST::load<Tree>(path); });
+    BST::save(MultiTree{1, 2, 2, 3}, path);
+    bool duplicates_rejected = rejects([&path] { BST::load<Tree>(path); });
+    MultiTree loaded = BST::load<MultiTree>(path);
+    std::filesystem::remove(path);
+
+    ASSERT_TRUE(reversed_rejected && duplicates_rejected && loaded.TraversalToVector() == std::vector<int>({1, 2, 2, 3}));
+}